@@ -0,0 +1,164 @@
+
+/// inotify cron daemon cgroup management implementation
+/**
+ * \file cgroup.cpp
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstring>
+
+#include "cgroup.h"
+#include "incroncfg.h"
+
+/// CPU period for cpu.max (microseconds)
+#define CGROUP_CPU_PERIOD 100000
+
+/// Controllers enabled for subgroups
+static const char* s_controllers[] = { "+cpu", "+memory", "+io", NULL };
+
+
+std::string Cgroup::s_root;
+bool Cgroup::s_fInit = false;
+
+
+/// Checks whether a memory limit has a valid syntax.
+/**
+ * \param[in] rVal limit ("max" or a number with an optional K/M/G/T suffix)
+ * \return true = valid, false = invalid
+ */
+static bool valid_memory(const std::string& rVal)
+{
+  if (rVal == "max")
+    return true;
+
+  size_t i = 0;
+  while (i < rVal.length() && rVal[i] >= '0' && rVal[i] <= '9') {
+    i++;
+  }
+
+  if (i == 0)
+    return false;
+
+  return i == rVal.length() || (i + 1 == rVal.length() && strchr("KMGTkmgt", rVal[i]) != NULL);
+}
+
+
+bool Cgroup::IsEnabled()
+{
+  if (!s_fInit) {
+    IncronCfg::GetValue("cgroup_root", s_root);
+    s_fInit = true;
+  }
+
+  return !s_root.empty();
+}
+
+int Cgroup::Create(const std::string& rName, const CgroupLimits_t& rLimits, bool fLeaf)
+{
+  if (!IsEnabled())
+    return -1;
+
+  // create parents with controllers for their subgroups
+  std::string dir(s_root);
+  EnableControllers(dir);
+  size_t pos = 0;
+  for (;;) {
+    size_t next = rName.find('/', pos);
+    dir = IncronCfg::BuildPath(s_root, rName.substr(0, next));
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+      syslog(LOG_ERR, "cannot create cgroup %s: (%i) %s", dir.c_str(), errno, strerror(errno));
+      return -1;
+    }
+
+    if (next == std::string::npos)
+      break;
+
+    EnableControllers(dir);
+    pos = next + 1;
+  }
+
+  // limits are set even to defaults (the group may be reused)
+  char s[32];
+  if (rLimits.cpuMax > 0) {
+    snprintf(s, sizeof(s), "%u %u", rLimits.cpuMax * (CGROUP_CPU_PERIOD / 100), CGROUP_CPU_PERIOD);
+    Write(dir, "cpu.max", s);
+  }
+  else {
+    Write(dir, "cpu.max", "max");
+  }
+
+  if (rLimits.memMax.empty()) {
+    Write(dir, "memory.max", "max");
+  }
+  else if (valid_memory(rLimits.memMax)) {
+    Write(dir, "memory.max", rLimits.memMax);
+  }
+  else {
+    syslog(LOG_WARNING, "invalid memory limit %s for cgroup %s", rLimits.memMax.c_str(), dir.c_str());
+  }
+
+  snprintf(s, sizeof(s), "default %u", rLimits.ioWeight > 0 ? rLimits.ioWeight : 100);
+  Write(dir, "io.weight", s);
+
+  if (!fLeaf)
+    return 0;
+
+  std::string procs = IncronCfg::BuildPath(dir, "cgroup.procs");
+  int fd = open(procs.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd == -1)
+    syslog(LOG_ERR, "cannot open %s: (%i) %s", procs.c_str(), errno, strerror(errno));
+
+  return fd;
+}
+
+void Cgroup::Remove(const std::string& rName)
+{
+  if (IsEnabled())
+    rmdir(IncronCfg::BuildPath(s_root, rName).c_str());
+}
+
+void Cgroup::InitLimits(CgroupLimits_t& rLimits)
+{
+  rLimits.cpuMax = 0;
+  rLimits.memMax.clear();
+  rLimits.ioWeight = 0;
+}
+
+void Cgroup::EnableControllers(const std::string& rDir)
+{
+  // one by one - some of them may be unavailable
+  for (int i=0; s_controllers[i] != NULL; i++) {
+    Write(rDir, "cgroup.subtree_control", s_controllers[i]);
+  }
+}
+
+bool Cgroup::Write(const std::string& rDir, const char* pszFile, const std::string& rVal)
+{
+  std::string path = IncronCfg::BuildPath(rDir, pszFile);
+  int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  // unavailable controllers are not fatal
+  bool ok = write(fd, rVal.c_str(), rVal.length()) == (ssize_t) rVal.length();
+  if (!ok && strcmp(pszFile, "cgroup.subtree_control") != 0)
+    syslog(LOG_WARNING, "cannot set %s to '%s': (%i) %s", path.c_str(), rVal.c_str(), errno, strerror(errno));
+
+  close(fd);
+  return ok;
+}
@@ -0,0 +1,101 @@
+
+/// inotify cron daemon cgroup management header
+/**
+ * \file cgroup.h
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+#ifndef _CGROUP_H_
+#define _CGROUP_H_
+
+#include <string>
+
+
+/// Resource limits of a cgroup
+typedef struct
+{
+  unsigned cpuMax;      ///< CPU limit (percents of one CPU; 0 = unlimited)
+  std::string memMax;   ///< memory limit (empty = unlimited)
+  unsigned ioWeight;    ///< I/O weight (0 = default)
+} CgroupLimits_t;
+
+
+/// Cgroup (version 2) management class.
+/**
+ * Jobs may be placed into cgroups created by the daemon below
+ * a configured (delegated) directory. Each table gets its own
+ * group with the configured table limits. Jobs of entries
+ * without limits run in its leaf group "jobs", entries with
+ * limits get their own leaf groups.
+ *
+ * Jobs enter their groups by writing to a cgroup.procs file
+ * opened by the daemon. Thus no path lookups are needed when
+ * starting jobs.
+ */
+class Cgroup
+{
+public:
+  /// Checks whether cgroups are used.
+  /**
+   * The configuration is read at the first call.
+   *
+   * \return true = used, false = not used
+   */
+  static bool IsEnabled();
+
+  /// Creates (or updates) a group.
+  /**
+   * Missing parent groups are created (with their controllers
+   * enabled for subgroups).
+   *
+   * \param[in] rName group name (relative to the root)
+   * \param[in] rLimits resource limits
+   * \param[in] fLeaf group for processes yes/no
+   * \return descriptor of cgroup.procs (leaf groups); 0 for other groups; -1 on error
+   */
+  static int Create(const std::string& rName, const CgroupLimits_t& rLimits, bool fLeaf);
+
+  /// Removes a group.
+  /**
+   * It fails silently if the group is still used.
+   *
+   * \param[in] rName group name (relative to the root)
+   */
+  static void Remove(const std::string& rName);
+
+  /// Clears limits.
+  /**
+   * \param[out] rLimits resource limits
+   */
+  static void InitLimits(CgroupLimits_t& rLimits);
+
+private:
+  static std::string s_root;  ///< root directory
+  static bool s_fInit;        ///< configuration read yes/no
+
+  /// Enables controllers for subgroups.
+  /**
+   * \param[in] rDir group directory
+   */
+  static void EnableControllers(const std::string& rDir);
+
+  /// Writes a value to a group file.
+  /**
+   * \param[in] rDir group directory
+   * \param[in] pszFile file name
+   * \param[in] rVal value
+   * \return true = success, false = failure
+   */
+  static bool Write(const std::string& rDir, const char* pszFile, const std::string& rVal);
+};
+
+
+#endif //_CGROUP_H_
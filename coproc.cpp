@@ -0,0 +1,419 @@
+
+/// inotify cron daemon coprocess implementation
+/**
+ * \file coproc.cpp
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+
+#include <pwd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <cstring>
+
+#include "coproc.h"
+#include "usertable.h"
+
+/// Minimum handler run time not considered as a crash (ms)
+#define COPROC_MIN_RUN 1000
+
+/// Initial restart delay after a crash (ms)
+#define COPROC_DELAY_MIN 1000
+
+/// Maximum restart delay (ms)
+#define COPROC_DELAY_MAX 60000
+
+/// Maximum count of undelivered records
+#define COPROC_MAX_RECORDS 65536
+
+/// Maximum size of unwritten output (bytes)
+#define COPROC_MAX_OUTPUT (16 * 1024 * 1024)
+
+
+COPROC_MAP Coprocess::s_map;
+
+
+/// Returns the monotonic time.
+/**
+ * \return time in milliseconds
+ */
+static uint64_t now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+/// Appends a TSV field (tabs, line ends and backslashes are escaped).
+/**
+ * \param[in] rS field value
+ * \param[out] rRec record
+ */
+static void append_tsv(const std::string& rS, std::string& rRec)
+{
+  for (size_t i=0; i<rS.length(); i++) {
+    switch (rS[i]) {
+      case '\t':  rRec.append("\\t");   break;
+      case '\n':  rRec.append("\\n");   break;
+      case '\r':  rRec.append("\\r");   break;
+      case '\\':  rRec.append("\\\\");  break;
+      default:    rRec.push_back(rS[i]);
+    }
+  }
+}
+
+/// Appends a JSON string (including quotes).
+/**
+ * Bytes above 127 are copied as they are (file names
+ * are expected to be UTF-8).
+ *
+ * \param[in] rS string value
+ * \param[out] rRec record
+ */
+static void append_json(const std::string& rS, std::string& rRec)
+{
+  rRec.push_back('"');
+  for (size_t i=0; i<rS.length(); i++) {
+    unsigned char c = (unsigned char) rS[i];
+    if (c == '"' || c == '\\') {
+      rRec.push_back('\\');
+      rRec.push_back((char) c);
+    }
+    else if (c < 0x20) {
+      char s[8];
+      snprintf(s, sizeof(s), "\\u%04x", (unsigned) c);
+      rRec.append(s);
+    }
+    else {
+      rRec.push_back((char) c);
+    }
+  }
+  rRec.push_back('"');
+}
+
+
+Coprocess::Coprocess(EventDispatcher* pEd, UserTable* pTab, const std::vector<std::string>& rArgv,
+    CoprocMode_t mode, bool fAck, const std::string& rLogId, int iCgroupFd, const JobSched_t* pSched)
+: m_pEd(pEd),
+  m_pTab(pTab),
+  m_argv(rArgv),
+  m_mode(mode),
+  m_fAck(fAck),
+  m_logId(rLogId),
+  m_cgFd(iCgroupFd),
+  m_pSched(pSched),
+  m_fd(-1),
+  m_pid(0),
+  m_events(0),
+  m_uStarted(0),
+  m_uDelay(0),
+  m_restartTimer(0),
+  m_uOutPos(0),
+  m_fOverflow(false)
+{
+
+}
+
+Coprocess::~Coprocess()
+{
+  m_pEd->GetTimers()->Cancel(m_restartTimer);
+
+  if (m_pid > 0)
+    s_map.erase(m_pid);
+
+  Close();
+
+  size_t lost = m_fAck ? m_unacked.size() : (m_out.length() > m_uOutPos ? 1 : 0);
+  if (lost > 0)
+    syslog(LOG_WARNING, "%s COPROC stopped with undelivered events", m_logId.c_str());
+}
+
+void Coprocess::Post(InotifyEvent& rEvt, const std::string& rPath)
+{
+  if (m_unacked.size() >= COPROC_MAX_RECORDS || m_out.length() - m_uOutPos >= COPROC_MAX_OUTPUT) {
+    if (!m_fOverflow) {
+      syslog(LOG_WARNING, "%s COPROC handler too slow, dropping events", m_logId.c_str());
+      m_fOverflow = true;
+    }
+    return;
+  }
+
+  m_fOverflow = false;
+
+  std::string rec;
+  Format(rEvt, rPath, rec);
+  m_out.append(rec);
+  if (m_fAck)
+    m_unacked.push_back(rec);
+
+  if (m_pid > 0) {
+    Flush();
+  }
+  else if (m_restartTimer == 0) {
+    if (!Start())
+      ScheduleRestart();
+  }
+}
+
+bool Coprocess::Finished(pid_t pid)
+{
+  COPROC_MAP::iterator it = s_map.find(pid);
+  if (it == s_map.end())
+    return false;
+
+  Coprocess* pCp = (*it).second;
+  s_map.erase(it);
+  pCp->OnExit();
+  return true;
+}
+
+bool Coprocess::Start()
+{
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+    syslog(LOG_ERR, "%s COPROC cannot create socket: (%i) %s", m_logId.c_str(), errno, strerror(errno));
+    return false;
+  }
+
+  // the handler's output is the acknowledgement channel
+  int fds[3] = { sv[1], m_fAck ? sv[1] : -1, -1 };
+  pid_t pid = m_pTab->RunAsUser(m_argv, fds, m_cgFd, m_pSched);
+  int err = errno;
+  close(sv[1]);
+
+  if (pid <= 0) {
+    close(sv[0]);
+    syslog(LOG_ERR, "%s COPROC cannot exec handler: (%i) %s", m_logId.c_str(), err, strerror(err));
+    return false;
+  }
+
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+
+  m_fd = sv[0];
+  m_pid = pid;
+  m_uStarted = now_ms();
+  m_events = 0;
+  m_in.clear();
+  s_map.insert(COPROC_MAP::value_type(pid, this));
+
+  syslog(LOG_INFO, "%s COPROC started (PID %i)", m_logId.c_str(), (int) pid);
+
+  // unacknowledged records are delivered again
+  if (m_fAck) {
+    m_out.clear();
+    m_uOutPos = 0;
+    for (size_t i=0; i<m_unacked.size(); i++) {
+      m_out.append(m_unacked[i]);
+    }
+  }
+
+  Flush();
+  return true;
+}
+
+void Coprocess::Close()
+{
+  if (m_fd == -1)
+    return;
+
+  if (m_events != 0)
+    m_pEd->UnregisterFd(m_fd);
+  close(m_fd);
+  m_fd = -1;
+  m_events = 0;
+}
+
+void Coprocess::Flush()
+{
+  if (m_fd == -1)
+    return;
+
+  while (m_uOutPos < m_out.length()) {
+    ssize_t n = send(m_fd, m_out.data() + m_uOutPos, m_out.length() - m_uOutPos, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n > 0) {
+      m_uOutPos += n;
+    }
+    else if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    else {
+      // the handler has closed its input - wait for its exit
+      if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        Close();
+        return;
+      }
+      break;
+    }
+  }
+
+  // written records are not kept unless they may be sent again
+  if (m_uOutPos == m_out.length()) {
+    m_out.clear();
+    m_uOutPos = 0;
+  }
+  else if (m_uOutPos > m_out.length() / 2) {
+    m_out.erase(0, m_uOutPos);
+    m_uOutPos = 0;
+  }
+
+  UpdatePoll();
+}
+
+void Coprocess::ReadAcks()
+{
+  char buf[4096];
+  for (;;) {
+    ssize_t n = recv(m_fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n == -1 && errno == EINTR)
+      continue;
+
+    if (n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      Close();
+      return;
+    }
+
+    if (n == -1)
+      break;
+
+    // without acknowledgements the output is not interesting
+    if (!m_fAck)
+      continue;
+
+    m_in.append(buf, n);
+
+    size_t pos;
+    while ((pos = m_in.find('\n')) != std::string::npos) {
+      if (m_unacked.empty()) {
+        syslog(LOG_WARNING, "%s COPROC unexpected acknowledgement", m_logId.c_str());
+      }
+      else {
+        if (m_in.compare(0, 3, "err") == 0) {
+          std::string rec(m_unacked.front(), 0, m_unacked.front().length() - 1);
+          syslog(LOG_WARNING, "%s COPROC failed (%s): %s", m_logId.c_str(), rec.c_str(), m_in.substr(0, pos).c_str());
+        }
+        m_unacked.pop_front();
+      }
+      m_in.erase(0, pos + 1);
+    }
+  }
+}
+
+void Coprocess::UpdatePoll()
+{
+  if (m_fd == -1)
+    return;
+
+  short events = POLLIN;
+  if (m_uOutPos < m_out.length())
+    events |= POLLOUT;
+
+  if (events != m_events) {
+    m_pEd->RegisterFd(m_fd, events, OnReady, this);
+    m_events = events;
+  }
+}
+
+void Coprocess::ScheduleRestart()
+{
+  if (m_out.length() == m_uOutPos && m_unacked.empty())
+    return;
+
+  if (m_uDelay == 0)
+    m_uDelay = COPROC_DELAY_MIN;
+  else if (m_uDelay < COPROC_DELAY_MAX)
+    m_uDelay = m_uDelay * 2 < COPROC_DELAY_MAX ? m_uDelay * 2 : COPROC_DELAY_MAX;
+
+  m_restartTimer = m_pEd->GetTimers()->Schedule(m_uDelay, OnRestartTimer, this);
+}
+
+void Coprocess::OnExit()
+{
+  syslog(LOG_WARNING, "%s COPROC handler (PID %i) finished", m_logId.c_str(), (int) m_pid);
+
+  Close();
+  m_pid = 0;
+
+  // a partially written record cannot be completed
+  if (!m_fAck && m_uOutPos > 0 && m_out[m_uOutPos - 1] != '\n') {
+    size_t pos = m_out.find('\n', m_uOutPos);
+    m_uOutPos = pos == std::string::npos ? m_out.length() : pos + 1;
+  }
+  m_out.erase(0, m_uOutPos);
+  m_uOutPos = 0;
+
+  // only a quick crash delays the restart
+  if (now_ms() - m_uStarted >= COPROC_MIN_RUN) {
+    m_uDelay = 0;
+    if (m_out.empty() && m_unacked.empty())
+      return;
+    if (Start())
+      return;
+  }
+
+  ScheduleRestart();
+}
+
+void Coprocess::Format(InotifyEvent& rEvt, const std::string& rPath, std::string& rRec) const
+{
+  std::string types;
+  rEvt.DumpTypes(types);
+
+  char mask[16];
+  snprintf(mask, sizeof(mask), "%u", (unsigned) rEvt.GetMask());
+
+  if (m_mode == CP_JSON) {
+    rRec.append("{\"path\":");
+    append_json(rPath, rRec);
+    rRec.append(",\"name\":");
+    append_json(rEvt.GetName(), rRec);
+    rRec.append(",\"events\":");
+    append_json(types, rRec);
+    rRec.append(",\"mask\":");
+    rRec.append(mask);
+    rRec.append("}\n");
+  }
+  else {
+    append_tsv(rPath, rRec);
+    rRec.push_back('\t');
+    append_tsv(rEvt.GetName(), rRec);
+    rRec.push_back('\t');
+    rRec.append(types);
+    rRec.push_back('\t');
+    rRec.append(mask);
+    rRec.push_back('\n');
+  }
+}
+
+void Coprocess::OnReady(int, short revents, void* pArg)
+{
+  Coprocess* pCp = (Coprocess*) pArg;
+
+  if (revents & (POLLIN | POLLHUP | POLLERR))
+    pCp->ReadAcks();
+
+  if (pCp->m_fd != -1 && (revents & POLLOUT))
+    pCp->Flush();
+}
+
+void Coprocess::OnRestartTimer(void* pArg)
+{
+  Coprocess* pCp = (Coprocess*) pArg;
+  pCp->m_restartTimer = 0;
+
+  if (pCp->m_pid == 0 && !pCp->Start())
+    pCp->ScheduleRestart();
+}
@@ -0,0 +1,179 @@
+
+/// inotify cron daemon coprocess header
+/**
+ * \file coproc.h
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+#ifndef _COPROC_H_
+#define _COPROC_H_
+
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "incrontab.h"
+#include "timerwheel.h"
+#include "jobspawn.h"
+
+
+class EventDispatcher;
+class UserTable;
+class InotifyEvent;
+class Coprocess;
+
+/// Process ID to coprocess mapping
+typedef std::map<pid_t, Coprocess*> COPROC_MAP;
+
+/// Event record list
+typedef std::deque<std::string> RECORD_LIST;
+
+
+/// Coprocess class.
+/**
+ * A coprocess is a long-lived handler of a table entry. Events
+ * are written to its standard input as records (one per line).
+ * If acknowledgements are enabled the handler writes one line
+ * to its standard output for each processed record. Records
+ * not acknowledged yet are sent again if the handler dies.
+ *
+ * The handler is started with the first event and restarted
+ * (with a growing delay if it dies quickly) while there are
+ * records to be delivered.
+ */
+class Coprocess
+{
+public:
+  /// Constructor.
+  /**
+   * The handler is not started here.
+   *
+   * \param[in] pEd event dispatcher
+   * \param[in] pTab owning table (for running the handler)
+   * \param[in] rArgv handler argument vector
+   * \param[in] mode record format
+   * \param[in] fAck acknowledgements yes/no
+   * \param[in] rLogId log message prefix
+   * \param[in] iCgroupFd cgroup.procs descriptor for the handler (-1 = none)
+   * \param[in] pSched scheduling attributes of the handler (NULL = inherited; kept by the caller)
+   */
+  Coprocess(EventDispatcher* pEd, UserTable* pTab, const std::vector<std::string>& rArgv,
+      CoprocMode_t mode, bool fAck, const std::string& rLogId, int iCgroupFd, const JobSched_t* pSched);
+
+  /// Destructor.
+  /**
+   * The handler gets the end of its input and finishes
+   * on its own. Undelivered records are lost.
+   */
+  ~Coprocess();
+
+  /// Passes an event to the handler.
+  /**
+   * \param[in] rEvt inotify event
+   * \param[in] rPath watched path
+   */
+  void Post(InotifyEvent& rEvt, const std::string& rPath);
+
+  /// Changes the limits of handlers started later.
+  /**
+   * A running handler is not affected.
+   *
+   * \param[in] iCgroupFd cgroup.procs descriptor for the handler (-1 = none)
+   * \param[in] pSched scheduling attributes of the handler (NULL = inherited; kept by the caller)
+   */
+  inline void SetLimits(int iCgroupFd, const JobSched_t* pSched)
+  {
+    m_cgFd = iCgroupFd;
+    m_pSched = pSched;
+  }
+
+  /// Processes a finished process.
+  /**
+   * \param[in] pid process ID
+   * \return true = it was a coprocess, false = otherwise
+   */
+  static bool Finished(pid_t pid);
+
+private:
+  EventDispatcher* m_pEd;   ///< event dispatcher
+  UserTable* m_pTab;        ///< owning table
+  std::vector<std::string> m_argv;  ///< handler argument vector
+  CoprocMode_t m_mode;      ///< record format
+  bool m_fAck;              ///< acknowledgements yes/no
+  std::string m_logId;      ///< log message prefix
+  int m_cgFd;               ///< cgroup.procs descriptor (-1 = none)
+  const JobSched_t* m_pSched; ///< scheduling attributes (NULL = inherited)
+  int m_fd;                 ///< socket descriptor (-1 = not running)
+  pid_t m_pid;              ///< handler process ID (0 = not running)
+  short m_events;           ///< currently polled events
+  uint64_t m_uStarted;      ///< handler start time (ms)
+  unsigned m_uDelay;        ///< current restart delay (ms)
+  TimerId_t m_restartTimer; ///< restart timer
+  std::string m_out;        ///< output buffer
+  size_t m_uOutPos;         ///< written part of the output buffer
+  std::string m_in;         ///< incomplete acknowledgement line
+  RECORD_LIST m_unacked;    ///< records not acknowledged yet
+  bool m_fOverflow;         ///< records are being dropped yes/no
+
+  static COPROC_MAP s_map;  ///< running handlers
+
+  /// Starts the handler.
+  /**
+   * \return true = success, false = failure
+   */
+  bool Start();
+
+  /// Closes the connection to the handler.
+  void Close();
+
+  /// Writes buffered records (as much as possible).
+  void Flush();
+
+  /// Reads acknowledgements.
+  void ReadAcks();
+
+  /// Updates polled events.
+  void UpdatePoll();
+
+  /// Schedules a restart (if there is something to deliver).
+  void ScheduleRestart();
+
+  /// Processes the handler exit.
+  void OnExit();
+
+  /// Formats an event record.
+  /**
+   * \param[in] rEvt inotify event
+   * \param[in] rPath watched path
+   * \param[out] rRec record (including the line end)
+   */
+  void Format(InotifyEvent& rEvt, const std::string& rPath, std::string& rRec) const;
+
+  /// Processes socket readiness.
+  /**
+   * \param[in] iFd socket descriptor
+   * \param[in] revents returned events
+   * \param[in] pArg coprocess
+   */
+  static void OnReady(int iFd, short revents, void* pArg);
+
+  /// Restarts the handler (timer callback).
+  /**
+   * \param[in] pArg coprocess
+   */
+  static void OnRestartTimer(void* pArg);
+};
+
+
+#endif //_COPROC_H_
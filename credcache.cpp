@@ -0,0 +1,155 @@
+
+/// inotify cron daemon credential cache implementation
+/**
+ * \file credcache.cpp
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+
+#include <pwd.h>
+#include <grp.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "credcache.h"
+#include "incroncfg.h"
+#include "usertable.h"
+
+/// User database file
+#define PASSWD_FILE "/etc/passwd"
+
+/// Group database file
+#define GROUP_FILE "/etc/group"
+
+/// Minimum interval between database checks (ms)
+#define CRED_CHECK_INTERVAL 1000
+
+
+CRED_MAP CredCache::s_map;
+uint64_t CredCache::s_checked = 0;
+time_t CredCache::s_pwdTime = 0;
+time_t CredCache::s_grpTime = 0;
+unsigned CredCache::s_uTtl = 0;
+bool CredCache::s_fInit = false;
+unsigned CredCache::s_uGen = 0;
+
+
+/// Returns the monotonic time.
+/**
+ * \return time in milliseconds
+ */
+static uint64_t cred_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+/// Returns the modification time of a file.
+/**
+ * \param[in] path file path
+ * \return modification time (0 = unknown)
+ */
+static time_t file_time(const char* path)
+{
+  struct stat st;
+  return stat(path, &st) == 0 ? st.st_mtime : 0;
+}
+
+
+const UserCred_t* CredCache::Get(const std::string& rUser)
+{
+  if (!s_fInit) {
+    IncronCfg::GetValue("cred_cache_ttl", s_uTtl);
+    s_fInit = true;
+  }
+
+  uint64_t now = cred_now();
+  Check(now);
+
+  CRED_MAP::iterator it = s_map.find(rUser);
+  if (it == s_map.end()) {
+    it = s_map.insert(CRED_MAP::value_type(rUser, UserCred_t())).first;
+    Load(rUser, (*it).second, now);
+  }
+  else if (now - (*it).second.loaded >= ((uint64_t) s_uTtl) * 1000) {
+    Load(rUser, (*it).second, now);
+  }
+
+  return &(*it).second;
+}
+
+bool CredCache::IsMember(const UserCred_t* pCred, gid_t gid)
+{
+  return std::binary_search(pCred->groups.begin(), pCred->groups.end(), gid);
+}
+
+void CredCache::Clear()
+{
+  s_map.clear();
+}
+
+void CredCache::Check(uint64_t now)
+{
+  if (s_checked != 0 && now - s_checked < CRED_CHECK_INTERVAL)
+    return;
+
+  s_checked = now;
+
+  time_t pt = file_time(PASSWD_FILE);
+  time_t gt = file_time(GROUP_FILE);
+  if (pt != s_pwdTime || gt != s_grpTime) {
+    s_pwdTime = pt;
+    s_grpTime = gt;
+    Clear();
+  }
+}
+
+void CredCache::Load(const std::string& rUser, UserCred_t& rCred, uint64_t now)
+{
+  rCred.loaded = now;
+  rCred.gen = ++s_uGen;
+  rCred.groups.clear();
+  rCred.env.clear();
+  rCred.envp.clear();
+
+  struct passwd* pwd = getpwnam(rUser.c_str());
+  rCred.fValid = pwd != NULL;
+  if (pwd == NULL)
+    return;
+
+  rCred.uid = pwd->pw_uid;
+  rCred.gid = pwd->pw_gid;
+
+  int ng = 32;
+  rCred.groups.resize(ng);
+  while (getgrouplist(rUser.c_str(), pwd->pw_gid, &rCred.groups[0], &ng) == -1) {
+    rCred.groups.resize(ng);
+  }
+  rCred.groups.resize(ng);
+  std::sort(rCred.groups.begin(), rCred.groups.end());
+
+  // root keeps the daemon's environment
+  if (pwd->pw_uid != 0) {
+    rCred.env.push_back(std::string("LOGNAME=") + pwd->pw_name);
+    rCred.env.push_back(std::string("USER=") + pwd->pw_name);
+    rCred.env.push_back(std::string("USERNAME=") + pwd->pw_name);
+    rCred.env.push_back(std::string("HOME=") + pwd->pw_dir);
+    rCred.env.push_back(std::string("SHELL=") + pwd->pw_shell);
+    rCred.env.push_back(std::string("PATH=") + DEFAULT_PATH);
+
+    for (size_t i=0; i<rCred.env.size(); i++) {
+      rCred.envp.push_back(&rCred.env[i][0]);
+    }
+    rCred.envp.push_back(NULL);
+  }
+}
@@ -0,0 +1,102 @@
+
+/// inotify cron daemon credential cache header
+/**
+ * \file credcache.h
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+#ifndef _CREDCACHE_H_
+#define _CREDCACHE_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/// Cached user credentials
+typedef struct
+{
+  bool fValid;                  ///< user exists yes/no
+  uid_t uid;                    ///< user ID
+  gid_t gid;                    ///< primary group ID
+  std::vector<gid_t> groups;    ///< all groups (sorted, including the primary one)
+  std::vector<std::string> env; ///< job environment (empty = inherited)
+  std::vector<char*> envp;      ///< job environment pointers (NULL terminated)
+  uint64_t loaded;              ///< load time (ms)
+  unsigned gen;                 ///< load generation (unique for each load)
+} UserCred_t;
+
+/// User name to credentials mapping
+typedef std::map<std::string, UserCred_t> CRED_MAP;
+
+
+/// Credential cache class.
+/**
+ * It keeps user and group database data needed for access
+ * checks and for starting jobs. Thus no lookups (which may
+ * go over the network) are done when processing events.
+ *
+ * Entries expire after a configured time. All entries are
+ * dropped when /etc/passwd or /etc/group changes. Data derived
+ * from credentials is valid only while their generation stays
+ * the same (it changes whenever the user's entry is reloaded).
+ */
+class CredCache
+{
+public:
+  /// Returns credentials of an user.
+  /**
+   * Nonexistent users are cached too (as invalid).
+   *
+   * \param[in] rUser user name
+   * \return credentials (valid until the next call)
+   */
+  static const UserCred_t* Get(const std::string& rUser);
+
+  /// Checks whether the user is a member of a group.
+  /**
+   * \param[in] pCred user credentials
+   * \param[in] gid group ID
+   * \return true = member, false = otherwise
+   */
+  static bool IsMember(const UserCred_t* pCred, gid_t gid);
+
+  /// Drops all cached data.
+  static void Clear();
+
+private:
+  static CRED_MAP s_map;        ///< cached credentials
+  static uint64_t s_checked;    ///< last database check time (ms)
+  static time_t s_pwdTime;      ///< modification time of /etc/passwd
+  static time_t s_grpTime;      ///< modification time of /etc/group
+  static unsigned s_uTtl;       ///< expiration time (s; 0 = no caching)
+  static bool s_fInit;          ///< configuration read yes/no
+  static unsigned s_uGen;       ///< last load generation
+
+  /// Drops all data if the databases have changed.
+  /**
+   * \param[in] now current time (ms)
+   */
+  static void Check(uint64_t now);
+
+  /// Loads credentials of an user.
+  /**
+   * \param[in] rUser user name
+   * \param[out] rCred credentials
+   * \param[in] now current time (ms)
+   */
+  static void Load(const std::string& rUser, UserCred_t& rCred, uint64_t now);
+};
+
+
+#endif //_CREDCACHE_H_
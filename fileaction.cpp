@@ -0,0 +1,416 @@
+
+/// inotify cron daemon built-in file actions implementation
+/**
+ * \file fileaction.cpp
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/fsuid.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/fs.h>
+#include <cstring>
+
+#include "fileaction.h"
+
+/// Maximum count of bytes copied at once
+#define COPY_CHUNK (1 << 30)
+
+/// Buffer size for copying by reading and writing
+#define COPY_BUF_LEN 65536
+
+
+extern int g_cldPipe[2];
+
+
+pthread_mutex_t FileAction::s_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t FileAction::s_cond = PTHREAD_COND_INITIALIZER;
+FILEACTION_LIST FileAction::s_queue;
+FILEACTIONDONE_LIST FileAction::s_done;
+bool FileAction::s_fStarted = false;
+
+
+/// Switches the filesystem credentials of the calling thread.
+/**
+ * The supplementary groups are set by the raw system call because
+ * the C library would change them for all threads.
+ *
+ * \param[in] uid user ID
+ * \param[in] gid group ID
+ * \param[in] rGroups supplementary groups
+ * \return true = success, false = failure
+ */
+static bool set_fs_creds(uid_t uid, gid_t gid, const std::vector<gid_t>& rGroups)
+{
+  if (syscall(SYS_setgroups, rGroups.size(), rGroups.empty() ? NULL : &rGroups[0]) != 0)
+    return false;
+
+  // the calls return the previous value, so success is checked by repeating them
+  setfsgid(gid);
+  if ((gid_t) setfsgid(gid) != gid)
+    return false;
+
+  setfsuid(uid);
+  return (uid_t) setfsuid(uid) == uid;
+}
+
+/// Opens the directory of a target.
+/**
+ * If the target is a directory (or ends with a slash) the source
+ * file name is appended to it. The directory is opened only once,
+ * so it cannot be swapped (e.g. for a symbolic link) between
+ * checking and using it.
+ *
+ * \param[in] rSrc source path
+ * \param[in] rDst target path
+ * \param[out] rName target name within the directory
+ * \return directory descriptor; -1 on error (errno is set)
+ */
+static int open_target(const std::string& rSrc, const std::string& rDst, std::string& rName)
+{
+  int fd = open(rDst.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (fd != -1 || (!rDst.empty() && rDst[rDst.length()-1] == '/')) {
+    size_t pos = rSrc.find_last_of('/');
+    rName = pos == std::string::npos ? rSrc : rSrc.substr(pos + 1);
+    return fd;
+  }
+
+  size_t pos = rDst.find_last_of('/');
+  rName = pos == std::string::npos ? rDst : rDst.substr(pos + 1);
+  std::string dir = pos == std::string::npos ? std::string(".") : rDst.substr(0, pos > 0 ? pos : 1);
+  return open(dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+}
+
+/// Creates a temporary file.
+/**
+ * \param[in] iDirFd directory descriptor
+ * \param[out] rName file name
+ * \return file descriptor (open for writing); -1 on error (errno is set)
+ */
+static int create_temp(int iDirFd, std::string& rName)
+{
+  static unsigned s_uCount = 0;
+
+  for (int i=0; i<100; i++) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    char s[32];
+    snprintf(s, sizeof(s), ".incron.%08x", (unsigned) ts.tv_nsec ^ (++s_uCount * 2654435761U));
+    int fd = openat(iDirFd, s, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd != -1 || errno != EEXIST) {
+      rName = s;
+      return fd;
+    }
+  }
+
+  return -1;
+}
+
+/// Subtracts resource usage.
+/**
+ * Only values meaningful for a thread are computed.
+ *
+ * \param[in,out] rA usage at the end (the difference at return)
+ * \param[in] rB usage at the beginning
+ */
+static void sub_usage(struct rusage& rA, const struct rusage& rB)
+{
+  timersub(&rA.ru_utime, &rB.ru_utime, &rA.ru_utime);
+  timersub(&rA.ru_stime, &rB.ru_stime, &rA.ru_stime);
+  rA.ru_maxrss = 0;
+  rA.ru_inblock -= rB.ru_inblock;
+  rA.ru_oublock -= rB.ru_oublock;
+}
+
+
+FileOp_t FileAction::GetOp(const std::string& rName)
+{
+  if (rName == "@move")
+    return FO_MOVE;
+  if (rName == "@copy")
+    return FO_COPY;
+  if (rName == "@link")
+    return FO_LINK;
+  if (rName == "@delete")
+    return FO_DELETE;
+  if (rName == "@chmod")
+    return FO_CHMOD;
+
+  return FO_NONE;
+}
+
+size_t FileAction::GetArgCount(FileOp_t op)
+{
+  return op == FO_DELETE ? 1 : 2;
+}
+
+bool FileAction::Submit(pid_t id, FileOp_t op, const std::vector<std::string>& rArgv, const UserCred_t* pCred)
+{
+  if (!s_fStarted) {
+    // the thread inherits the mask, so all signals go to the main thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    pthread_t t;
+    int res = pthread_create(&t, NULL, Work, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (res != 0) {
+      errno = res;
+      return false;
+    }
+
+    pthread_detach(t);
+    s_fStarted = true;
+  }
+
+  FileActionReq_t* pReq = new FileActionReq_t;
+  pReq->id = id;
+  pReq->op = op;
+  pReq->args.assign(rArgv.begin() + 1, rArgv.end());
+  pReq->fSetCreds = pCred != NULL;
+  if (pCred != NULL) {
+    pReq->uid = pCred->uid;
+    pReq->gid = pCred->gid;
+    pReq->groups = pCred->groups;
+  }
+
+  pthread_mutex_lock(&s_mutex);
+  s_queue.push_back(pReq);
+  pthread_cond_signal(&s_cond);
+  pthread_mutex_unlock(&s_mutex);
+
+  return true;
+}
+
+bool FileAction::GetDone(FileActionDone_t& rDone)
+{
+  pthread_mutex_lock(&s_mutex);
+  bool ok = !s_done.empty();
+  if (ok) {
+    rDone = s_done.front();
+    s_done.pop_front();
+  }
+  pthread_mutex_unlock(&s_mutex);
+
+  return ok;
+}
+
+void* FileAction::Work(void*)
+{
+  // the daemon's own credentials (restored after each action)
+  uid_t uid = geteuid();
+  gid_t gid = getegid();
+  std::vector<gid_t> groups;
+  int n = getgroups(0, NULL);
+  if (n > 0) {
+    groups.resize(n);
+    n = getgroups(n, &groups[0]);
+    groups.resize(n > 0 ? n : 0);
+  }
+
+  for (;;) {
+    pthread_mutex_lock(&s_mutex);
+    while (s_queue.empty()) {
+      pthread_cond_wait(&s_cond, &s_mutex);
+    }
+    FileActionReq_t* pReq = s_queue.front();
+    s_queue.pop_front();
+    pthread_mutex_unlock(&s_mutex);
+
+    FileActionDone_t done;
+    done.id = pReq->id;
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+
+    if (pReq->fSetCreds && !set_fs_creds(pReq->uid, pReq->gid, pReq->groups))
+      done.error = EPERM;
+    else
+      done.error = Perform(*pReq);
+
+    // the thread cannot go on with wrong credentials
+    if (pReq->fSetCreds && !set_fs_creds(uid, gid, groups))
+      abort();
+
+    getrusage(RUSAGE_THREAD, &done.usage);
+    sub_usage(done.usage, ru);
+    delete pReq;
+
+    pthread_mutex_lock(&s_mutex);
+    s_done.push_back(done);
+    pthread_mutex_unlock(&s_mutex);
+
+    // let the main loop pick it up
+    if (write(g_cldPipe[1], "X", 1) <= 0) {
+      syslog(LOG_WARNING, "cannot send action token to notification pipe");
+    }
+  }
+
+  return NULL;
+}
+
+int FileAction::Perform(const FileActionReq_t& rReq)
+{
+  const std::vector<std::string>& a = rReq.args;
+  if (a.size() != GetArgCount(rReq.op))
+    return EINVAL;
+
+  std::string name;
+  int dir = -1;
+  if (rReq.op == FO_MOVE || rReq.op == FO_COPY || rReq.op == FO_LINK) {
+    dir = open_target(a[0], a[1], name);
+    if (dir == -1)
+      return errno;
+  }
+
+  int err = 0;
+  switch (rReq.op) {
+    case FO_MOVE:
+      if (renameat(AT_FDCWD, a[0].c_str(), dir, name.c_str()) != 0)
+        err = errno;
+
+      // across filesystems it is a copy followed by a removal
+      // (Copy() refuses the same file, e.g. seen through a bind mount)
+      if (err == EXDEV) {
+        err = Copy(a[0], dir, name);
+        if (err == 0 && unlink(a[0].c_str()) != 0)
+          err = errno;
+      }
+      close(dir);
+      return err;
+    case FO_COPY:
+      err = Copy(a[0], dir, name);
+      close(dir);
+      return err;
+    case FO_LINK:
+      if (linkat(AT_FDCWD, a[0].c_str(), dir, name.c_str(), 0) != 0)
+        err = errno;
+      close(dir);
+      return err;
+    case FO_DELETE:
+      if (unlink(a[0].c_str()) == 0)
+        return 0;
+      if (errno != EISDIR)
+        return errno;
+      return rmdir(a[0].c_str()) == 0 ? 0 : errno;
+    case FO_CHMOD: {
+        char* end;
+        unsigned long mode = strtoul(a[0].c_str(), &end, 8);
+        if (a[0].empty() || *end != '\0' || mode > 07777)
+          return EINVAL;
+        return chmod(a[1].c_str(), (mode_t) mode) == 0 ? 0 : errno;
+      }
+    default:
+      return EINVAL;
+  }
+}
+
+int FileAction::Copy(const std::string& rSrc, int iDirFd, const std::string& rName)
+{
+  int in = open(rSrc.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in == -1)
+    return errno;
+
+  struct stat st;
+  int res = fstat(in, &st);
+  if (res != 0 || !S_ISREG(st.st_mode)) {
+    int err = res != 0 ? errno : EINVAL;
+    close(in);
+    return err;
+  }
+
+  // copying a file onto itself would destroy it
+  struct stat dst;
+  if (fstatat(iDirFd, rName.c_str(), &dst, 0) == 0 && dst.st_dev == st.st_dev && dst.st_ino == st.st_ino) {
+    close(in);
+    return EINVAL;
+  }
+
+  // the target appears complete or not at all
+  std::string tmp;
+  int out = create_temp(iDirFd, tmp);
+  if (out == -1) {
+    int err = errno;
+    close(in);
+    return err;
+  }
+
+  int err = 0;
+  bool done = false;
+
+#ifdef FICLONE
+  done = ioctl(out, FICLONE, in) == 0;
+#endif // FICLONE
+
+#ifdef SYS_copy_file_range
+  // unsupported in-kernel copies fall back to reading and writing
+  off_t copied = 0;
+  while (!done) {
+    ssize_t n = syscall(SYS_copy_file_range, in, NULL, out, NULL, COPY_CHUNK, 0);
+    if (n == 0) {
+      done = true;
+    }
+    else if (n > 0) {
+      copied += n;
+    }
+    else if (copied > 0 || (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP)) {
+      err = errno;
+      done = true;
+    }
+    else {
+      break;
+    }
+  }
+#endif // SYS_copy_file_range
+
+  if (!done) {
+    char buf[COPY_BUF_LEN];
+    ssize_t n;
+    while (err == 0 && (n = read(in, buf, sizeof(buf))) != 0) {
+      if (n == -1) {
+        if (errno != EINTR)
+          err = errno;
+        continue;
+      }
+      for (ssize_t w = 0; err == 0 && w < n; ) {
+        ssize_t k = write(out, buf + w, n - w);
+        if (k > 0)
+          w += k;
+        else if (errno != EINTR)
+          err = errno;
+      }
+    }
+  }
+
+  close(in);
+  if (err == 0 && fchmod(out, st.st_mode & 0777) != 0)
+    err = errno;
+  if (close(out) != 0 && err == 0)
+    err = errno;
+
+  if (err == 0 && renameat(iDirFd, tmp.c_str(), iDirFd, rName.c_str()) != 0)
+    err = errno;
+  if (err != 0)
+    unlinkat(iDirFd, tmp.c_str(), 0);
+
+  return err;
+}
@@ -0,0 +1,157 @@
+
+/// inotify cron daemon built-in file actions header
+/**
+ * \file fileaction.h
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+#ifndef _FILEACTION_H_
+#define _FILEACTION_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "credcache.h"
+
+
+/// Built-in file operations
+typedef enum
+{
+  FO_NONE,      ///< no built-in operation (a command)
+  FO_MOVE,      ///< @move SOURCE TARGET
+  FO_COPY,      ///< @copy SOURCE TARGET
+  FO_LINK,      ///< @link SOURCE TARGET (hard link)
+  FO_DELETE,    ///< @delete PATH
+  FO_CHMOD      ///< @chmod MODE PATH (octal mode)
+} FileOp_t;
+
+/// File action request
+typedef struct
+{
+  pid_t id;             ///< action ID (pseudo process ID)
+  FileOp_t op;          ///< operation
+  std::vector<std::string> args;  ///< arguments (without the action name)
+  bool fSetCreds;       ///< switch credentials yes/no
+  uid_t uid;            ///< user ID
+  gid_t gid;            ///< group ID
+  std::vector<gid_t> groups;  ///< supplementary groups
+} FileActionReq_t;
+
+/// Finished file action data
+typedef struct
+{
+  pid_t id;             ///< action ID
+  int error;            ///< error number (0 = success)
+  struct rusage usage;  ///< resource usage
+} FileActionDone_t;
+
+/// File action request list
+typedef std::deque<FileActionReq_t*> FILEACTION_LIST;
+
+/// Finished file action list
+typedef std::deque<FileActionDone_t> FILEACTIONDONE_LIST;
+
+
+/// Built-in file action class.
+/**
+ * Simple file operations (moving, copying, linking, deleting
+ * and changing permissions) are performed by the daemon itself
+ * instead of spawning a shell and a program for each event.
+ *
+ * The operations run one after another in a worker thread so
+ * that big copies do not block event processing. For user
+ * tables the thread switches its filesystem credentials
+ * (fsuid, fsgid and supplementary groups) which affect only
+ * the thread itself, so permissions are checked exactly as for
+ * a program run by the user.
+ *
+ * Finished actions are collected for the daemon which picks
+ * them by GetDone(). It is notified through the same pipe
+ * as SIGCHLD.
+ */
+class FileAction
+{
+public:
+  /// Returns the operation for an action name.
+  /**
+   * \param[in] rName action name (e.g. "@move")
+   * \return operation; FO_NONE for unknown names
+   */
+  static FileOp_t GetOp(const std::string& rName);
+
+  /// Returns the count of arguments of an operation.
+  /**
+   * \param[in] op operation
+   * \return count of arguments (without the action name)
+   */
+  static size_t GetArgCount(FileOp_t op);
+
+  /// Queues an action.
+  /**
+   * The worker thread is started with the first action.
+   *
+   * \param[in] id action ID
+   * \param[in] op operation
+   * \param[in] rArgv action name and arguments
+   * \param[in] pCred credentials (NULL = the daemon's ones)
+   * \return true = success, false = failure (errno is set)
+   */
+  static bool Submit(pid_t id, FileOp_t op, const std::vector<std::string>& rArgv, const UserCred_t* pCred);
+
+  /// Fetches a finished action.
+  /**
+   * \param[out] rDone finished action data
+   * \return true = action fetched, false = no finished action
+   */
+  static bool GetDone(FileActionDone_t& rDone);
+
+private:
+  static pthread_mutex_t s_mutex;   ///< queue lock
+  static pthread_cond_t s_cond;     ///< queue signal
+  static FILEACTION_LIST s_queue;   ///< queued actions
+  static FILEACTIONDONE_LIST s_done;  ///< finished actions
+  static bool s_fStarted;           ///< worker thread started yes/no
+
+  /// Runs the worker loop.
+  /**
+   * \param[in] pArg unused
+   * \return never returns
+   */
+  static void* Work(void* pArg);
+
+  /// Performs an action.
+  /**
+   * \param[in] rReq action request
+   * \return error number (0 = success)
+   */
+  static int Perform(const FileActionReq_t& rReq);
+
+  /// Copies a regular file.
+  /**
+   * Reflinking is tried first, then an in-kernel copy
+   * and finally reading and writing. The data goes to
+   * a temporary file which then replaces the target.
+   * Copying a file onto itself fails (EINVAL).
+   *
+   * \param[in] rSrc source path
+   * \param[in] iDirFd target directory descriptor
+   * \param[in] rName target name within the directory
+   * \return error number (0 = success)
+   */
+  static int Copy(const std::string& rSrc, int iDirFd, const std::string& rName);
+};
+
+
+#endif //_FILEACTION_H_
@@ -40,6 +40,8 @@
 #include "incrontab.h"
 #include "usertable.h"
 #include "incroncfg.h"
+#include "launcher.h"
+#include "plugin.h"
 
 /// Logging options (console as fallback, log PID)
 #define INCRON_LOG_OPTS (LOG_CONS | LOG_PID)
@@ -75,6 +77,9 @@ SUT_MAP g_ut;
 /// Finish program yes/no
 volatile bool g_fFinish = false;
 
+/// Dump statistics yes/no
+volatile bool g_fDumpStats = false;
+
 /// Pipe for notifying about dead children
 int g_cldPipe[2];
 
@@ -92,8 +97,10 @@ bool g_daemon = true;
 /**
  * For SIGTERM and SIGINT it sets the program finish variable.
  * For SIGCHLD it writes a character into the notification pipe
- * (this is a workaround made due to disability to reliably
- * wait for dead children).
+ * (dead children are reaped in the main loop, see
+ * UserTable::FinishDone()).
+ * For SIGUSR1 it requests dumping statistics (and wakes the
+ * main loop through the notification pipe).
  * 
  * \param[in] signo signal number
  */
@@ -105,7 +112,6 @@ void on_signal(int signo)
       g_fFinish = true;
       break;
     case SIGCHLD:
-      do {} while (waitpid((pid_t)-1, 0, WNOHANG) > 0); /* Prevent zombies */
       // first empty pipe (to prevent internal buffer overflow)
       do {} while (read(g_cldPipe[0], g_cldPipeBuf, CHILD_PIPE_BUF_LEN) > 0);
       
@@ -114,6 +120,12 @@ void on_signal(int signo)
         syslog(LOG_WARNING, "cannot send SIGCHLD token to notification pipe");
       }
       break;
+    case SIGUSR1:
+      g_fDumpStats = true;
+      if (write(g_cldPipe[1], "S", 1) <= 0) {
+        syslog(LOG_WARNING, "cannot send SIGUSR1 token to notification pipe");
+      }
+      break;
     default:;
   }
 }
@@ -234,6 +246,20 @@ void free_tables(EventDispatcher* pEd)
   g_ut.clear();
 }
 
+/// Writes statistics of all tables to the system log.
+void dump_stats()
+{
+  syslog(LOG_NOTICE, "STATS jobs running %u, queued %u",
+      (unsigned) UserTable::GetRunningCount(),
+      (unsigned) UserTable::GetQueuedCount());
+  
+  SUT_MAP::iterator it = g_ut.begin();
+  while (it != g_ut.end()) {
+    (*it).second->DumpStats();
+    it++;
+  }
+}
+
 /// Prepares a 'dead/done child' notification pipe.
 /**
  * This function returns no value at all and on error it
@@ -313,6 +339,16 @@ void init_poll_array(struct pollfd pfd[], int pipefd, int infd)
  */
 int main(int argc, char** argv)
 {
+  // plugins of user tables are hosted by this executable (see Plugin)
+  if (argc >= 3 && strcmp(argv[1], PLUGIN_HOST_OPTION) == 0) {
+    openlog(INCROND_NAME, INCRON_LOG_OPTS, INCRON_LOG_FACIL);
+    return Plugin::RunHost(argv[2], argc > 3 ? argv[3] : "");
+  }
+  
+  // so are the user launchers (see Launcher)
+  if (argc == 3 && strcmp(argv[1], LAUNCHER_OPTION) == 0)
+    return Launcher::Run(argv[2]);
+  
   AppArgs::Init();
 
   if (!(  AppArgs::AddOption("about",       '?', AAT_NO_VALUE, false)
@@ -458,15 +494,18 @@ int main(int argc, char** argv)
     signal(SIGTERM, on_signal);
     signal(SIGINT, on_signal);
     signal(SIGCHLD, on_signal);
+    signal(SIGUSR1, on_signal);
     
     syslog(LOG_NOTICE, "ready to process filesystem events");
     
     while (!g_fFinish) {
       
-      int res = poll(ed.GetPollData(), ed.GetSize(), -1);
+      struct pollfd* pfd = ed.GetPollData();
+      int res = poll(pfd, ed.GetSize(), -1);
       
       if (res > 0) {
-        ed.ProcessEvents();
+        if (ed.ProcessEvents())
+          UserTable::FinishDone();
       }
       else if (res < 0) {
         switch (errno) {
@@ -481,12 +520,14 @@ int main(int argc, char** argv)
         } 
       }
       
-      // TODO try to do the finish thing all the time (there is a race condition somewhere
-      // it seem ProcessEvents returns too ealy sometimes
-      //UserTable::FinishDone();
+      if (g_fDumpStats) {
+        g_fDumpStats = false;
+        dump_stats();
+      }
     }
     
     free_tables(&ed);
+    Launcher::RetireAll();
     
     if (g_cldPipe[0] != -1)
       close(g_cldPipe[0]);
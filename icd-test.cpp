@@ -0,0 +1,757 @@
+
+/// inotify cron daemon unit tests
+/**
+ * \file icd-test.cpp
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ * The tests use temporary files in $TMPDIR (or /tmp) and
+ * real time (they take a few seconds). The dispatcher tests
+ * run real commands through /bin/sh.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "inotify-cxx.h"
+#include "incroncfg.h"
+#include "timerwheel.h"
+#include "usertable.h"
+#include "fileaction.h"
+
+
+// globals normally defined by the daemon (see icd-main.cpp)
+SUT_MAP g_ut;
+volatile bool g_fFinish = false;
+volatile bool g_fDumpStats = false;
+int g_cldPipe[2];
+bool g_daemon = false;
+
+/// Count of failed checks
+static unsigned s_uFailed = 0;
+
+/// Checks a condition.
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+
+/// Reports a failed check.
+/**
+ * \param[in] fOk check result
+ * \param[in] pszExpr checked expression
+ * \param[in] pszFile source file
+ * \param[in] iLine source line
+ */
+static void check(bool fOk, const char* pszExpr, const char* pszFile, int iLine)
+{
+  if (!fOk) {
+    fprintf(stderr, "%s:%i: check failed: %s\n", pszFile, iLine, pszExpr);
+    s_uFailed++;
+  }
+}
+
+/// Creates a temporary directory.
+/**
+ * \return directory path
+ */
+static std::string make_temp_dir()
+{
+  const char* pszTmp = getenv("TMPDIR");
+  std::string path(pszTmp != NULL && *pszTmp != '\0' ? pszTmp : "/tmp");
+  path.append("/icd-test.XXXXXX");
+
+  std::vector<char> buf(path.begin(), path.end());
+  buf.push_back('\0');
+  if (mkdtemp(&buf[0]) == NULL) {
+    perror("mkdtemp");
+    exit(1);
+  }
+  return std::string(&buf[0]);
+}
+
+/// Creates an empty file.
+/**
+ * \param[in] rPath file path
+ */
+static void touch(const std::string& rPath)
+{
+  int fd = open(rPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd != -1)
+    close(fd);
+}
+
+/// Spilled events must come back in the original order.
+/**
+ * \param[in] rDir temporary directory
+ */
+static void test_spill(const std::string& rDir)
+{
+  std::string watched(rDir + "/spill");
+  mkdir(watched.c_str(), 0755);
+
+  Inotify in;
+  in.SetBacklogLimit(3, rDir);
+  InotifyWatch* pW = new InotifyWatch(watched, IN_CREATE);
+  in.Add(pW);
+
+  const int count = 20;
+  for (int i=0; i<count; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "f%02i", i);
+    touch(watched + "/" + name);
+  }
+
+  in.SetNonBlock(true);
+  while (in.GetEventCount() < (size_t) count) {
+    size_t n = in.GetEventCount();
+    in.WaitForEvents(true);
+    if (in.GetEventCount() == n)
+      break;
+  }
+
+  CHECK(in.GetEventCount() == (size_t) count);
+  CHECK(in.GetSpilledCount() > 0);
+
+  InotifyEvent evt;
+  int i = 0;
+  while (in.GetEvent(evt)) {
+    char name[16];
+    snprintf(name, sizeof(name), "f%02i", i++);
+    CHECK(evt.GetName() == name);
+  }
+
+  CHECK(i == count);
+  CHECK(in.GetSpilledCount() == 0);
+  CHECK(in.GetLostCount() == 0);
+
+  in.RemoveAll();
+  delete pW;
+}
+
+/// Spilled events of disabled watches must not be lost.
+/**
+ * Oneshot watches and watches removed by the kernel (IN_IGNORED)
+ * lose their descriptors before their events are read back.
+ * 
+ * \param[in] rDir temporary directory
+ */
+static void test_spill_disabled(const std::string& rDir)
+{
+  std::string filler(rDir + "/filler");
+  std::string oneshot(rDir + "/oneshot");
+  std::string removed(rDir + "/removed");
+  mkdir(filler.c_str(), 0755);
+  touch(oneshot);
+  mkdir(removed.c_str(), 0755);
+
+  Inotify in;
+  in.SetBacklogLimit(1, rDir);
+  InotifyWatch* pW1 = new InotifyWatch(filler, IN_CREATE);
+  InotifyWatch* pW2 = new InotifyWatch(oneshot, IN_ATTRIB | IN_ONESHOT);
+  InotifyWatch* pW3 = new InotifyWatch(removed, IN_DELETE_SELF);
+  in.Add(pW1);
+  in.Add(pW2);
+  in.Add(pW3);
+
+  touch(filler + "/a");
+  touch(filler + "/b");
+  chmod(oneshot.c_str(), 0600);
+  rmdir(removed.c_str());
+  touch(filler + "/c");
+
+  in.SetNonBlock(true);
+  in.WaitForEvents(true);
+
+  CHECK(in.GetSpilledCount() > 0);
+  CHECK(!pW2->IsEnabled());
+  CHECK(!pW3->IsEnabled());
+
+  InotifyEvent evt;
+  std::string seq;
+  while (in.GetEvent(evt)) {
+    if (!seq.empty())
+      seq.push_back(' ');
+    if (evt.GetWatch() == pW1)
+      seq.append(evt.GetName());
+    else if (evt.GetWatch() == pW2)
+      seq.append(evt.IsType(IN_ATTRIB) ? "attrib" : "?");
+    else if (evt.GetWatch() == pW3)
+      seq.append(evt.IsType(IN_DELETE_SELF) ? "delete" : evt.IsType(IN_IGNORED) ? "ignored" : "?");
+  }
+
+  CHECK(seq == "a b attrib delete ignored c");
+  CHECK(in.GetLostCount() == 0);
+
+  in.RemoveAll();
+  delete pW1;
+  delete pW2;
+  delete pW3;
+}
+
+/// Timer expiration record
+typedef struct
+{
+  uint64_t delay;     ///< requested delay
+  uint64_t start;     ///< scheduling time
+  uint64_t fired;     ///< expiration time (0 = not expired)
+} TimerRec_t;
+
+/// Records a timer expiration.
+/**
+ * \param[in] pArg timer record
+ */
+static void on_timer(void* pArg)
+{
+  ((TimerRec_t*) pArg)->fired = TimerWheel::Now();
+}
+
+/// Timers around wheel level boundaries must expire in time.
+static void test_timer_wheel()
+{
+  TimerWheel tw;
+
+  // slot and level boundaries of the first two levels
+  const uint64_t delays[] = { 0, 1, TW_SLOTS - 1, TW_SLOTS, TW_SLOTS + 1, 2 * TW_SLOTS - 1, 2 * TW_SLOTS, 3 * TW_SLOTS + 7 };
+  const size_t n = sizeof(delays) / sizeof(delays[0]);
+
+  std::vector<TimerRec_t> recs(n);
+  for (size_t i=0; i<n; i++) {
+    recs[i].delay = delays[i];
+    recs[i].start = TimerWheel::Now();
+    recs[i].fired = 0;
+    tw.Schedule(delays[i], on_timer, &recs[i]);
+  }
+
+  // timers beyond the second level are only placed and cancelled
+  TimerRec_t far;
+  far.fired = 0;
+  TimerId_t id1 = tw.Schedule((uint64_t) 1 << (2 * TW_BITS), on_timer, &far);
+  TimerId_t id2 = tw.Schedule(TW_MAX_DELAY * 2, on_timer, &far);
+  CHECK(tw.GetCount() == n + 2);
+  CHECK(tw.Cancel(id1));
+  CHECK(tw.Cancel(id2));
+  CHECK(!tw.Cancel(id2));
+  CHECK(tw.GetCount() == n);
+
+  uint64_t deadline = TimerWheel::Now() + delays[n-1] + 1000;
+  while (tw.GetCount() > 0 && TimerWheel::Now() < deadline) {
+    struct pollfd pfd;
+    pfd.fd = tw.GetDescriptor();
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 100) > 0)
+      tw.Process();
+  }
+
+  CHECK(tw.GetCount() == 0);
+  CHECK(far.fired == 0);
+  for (size_t i=0; i<n; i++) {
+    CHECK(recs[i].fired != 0);
+    CHECK(recs[i].fired >= recs[i].start + recs[i].delay);
+    CHECK(recs[i].fired <= recs[i].start + recs[i].delay + 100);
+  }
+}
+
+/// Token bucket arithmetic.
+static void test_bucket()
+{
+  TokenBucket_t b;
+
+  init_bucket(b, 2, 5);
+  CHECK(b.rate == 2 && b.burst == 5 && b.tokens == 5);
+
+  // the first refill only sets the time
+  b.tokens = 0;
+  refill_bucket(b, 1000);
+  CHECK(b.tokens == 0);
+
+  refill_bucket(b, 1500);
+  CHECK(b.tokens == 1);
+
+  // time going backwards adds nothing
+  refill_bucket(b, 1400);
+  CHECK(b.tokens == 1);
+
+  // reserved tokens are paid back first
+  b.tokens = -2;
+  refill_bucket(b, 2400);
+  CHECK(b.tokens == 0);
+
+  refill_bucket(b, 100000);
+  CHECK(b.tokens == 5);
+
+  // default capacity: one second worth of tokens, at least one
+  init_bucket(b, 10, 0);
+  CHECK(b.burst == 10);
+  init_bucket(b, 0.5, 0);
+  CHECK(b.burst == 1);
+
+  // unlimited
+  init_bucket(b, -1, 0);
+  CHECK(b.rate == 0 && b.burst == 1);
+  b.tokens = 0;
+  refill_bucket(b, 1000);
+  refill_bucket(b, 9000);
+  CHECK(b.tokens == 0);
+}
+
+/// Converts a command word into a string (wildcards as '$x').
+/**
+ * \param[in] rWord command word
+ * \return string
+ */
+static std::string word_str(const CMD_WORD& rWord)
+{
+  std::string s;
+  for (size_t i=0; i<rWord.size(); i++) {
+    if (rWord[i].wildcard != 0) {
+      s.push_back('$');
+      s.push_back(rWord[i].wildcard);
+    }
+    else {
+      s.append("[" + rWord[i].text + "]");
+    }
+  }
+  return s;
+}
+
+/// Splitting commands for direct execution.
+static void test_parse_direct()
+{
+  std::vector<CMD_WORD> words;
+
+  CHECK(UserTable::ParseDirect("/bin/echo  a\tb", words));
+  CHECK(words.size() == 3);
+  CHECK(words.size() == 3 && word_str(words[2]) == "[b]");
+
+  CHECK(UserTable::ParseDirect("/bin/cp $@/$# /backup/$#.bak", words));
+  CHECK(words.size() == 3);
+  CHECK(words.size() == 3 && word_str(words[1]) == "$@[/]$#");
+  CHECK(words.size() == 3 && word_str(words[2]) == "[/backup/]$#[.bak]");
+
+  CHECK(UserTable::ParseDirect("@move $@/$# /dst", words));
+  CHECK(!UserTable::ParseDirect("echo a", words));
+  CHECK(!UserTable::ParseDirect("$@/run", words));
+  CHECK(!UserTable::ParseDirect("/bin/echo 'a b'", words));
+  CHECK(!UserTable::ParseDirect("/bin/echo a\\ b", words));
+  CHECK(!UserTable::ParseDirect("/bin/echo a > /dev/null", words));
+  CHECK(!UserTable::ParseDirect("/bin/echo *", words));
+  CHECK(!UserTable::ParseDirect("/bin/echo $$", words));
+  CHECK(!UserTable::ParseDirect("", words));
+}
+
+/// Compiling commands for the shell.
+static void test_compile_shell()
+{
+  CMD_WORD templ;
+  UserTable::CompileShell("echo $$ $@/$# $x 'q'", templ);
+  CHECK(word_str(templ) == "[echo $ ]$@[/]$#[ x 'q']");
+
+  UserTable::CompileShell("$%$&", templ);
+  CHECK(word_str(templ) == "$%$&");
+
+  UserTable::CompileShell("a$", templ);
+  CHECK(word_str(templ) == "[a]");
+
+  std::string out;
+  IncronTabEntry::AppendSafePath("a b\\c", out);
+  CHECK(out == "a\\ b\\\\c");
+}
+
+/// Values of the ordered= option.
+static void test_ordered_option()
+{
+  IncronTabEntry e;
+
+  CHECK(IncronTabEntry::Parse("/tmp IN_CREATE,ordered=true /bin/true", e));
+  CHECK(e.GetOrderKey() == "$@/$#");
+  CHECK(IncronTabEntry::Parse("/tmp IN_CREATE,ordered=yes /bin/true", e));
+  CHECK(e.GetOrderKey() == "$@/$#");
+  CHECK(IncronTabEntry::Parse("/tmp IN_CREATE,ordered=false /bin/true", e));
+  CHECK(e.GetOrderKey().empty());
+  CHECK(IncronTabEntry::Parse("/tmp IN_CREATE,ordered=no /bin/true", e));
+  CHECK(e.GetOrderKey().empty());
+  CHECK(IncronTabEntry::Parse("/tmp IN_CREATE,ordered=$# /bin/true", e));
+  CHECK(e.GetOrderKey() == "$#");
+
+  // constant keys would serialize all commands
+  CHECK(!IncronTabEntry::Parse("/tmp IN_CREATE,ordered=treu /bin/true", e));
+  CHECK(!IncronTabEntry::Parse("/tmp IN_CREATE,ordered=$$@ /bin/true", e));
+  CHECK(!IncronTabEntry::Parse("/tmp IN_CREATE,ordered= /bin/true", e));
+}
+
+/// Waits for a finished file action.
+/**
+ * \param[out] rDone finished action
+ * \return true = finished, false = timed out
+ */
+static bool wait_action(FileActionDone_t& rDone)
+{
+  for (int i=0; i<50; i++) {
+    struct pollfd pfd;
+    pfd.fd = g_cldPipe[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 100) > 0) {
+      char c;
+      while (read(g_cldPipe[0], &c, 1) > 0) {}
+    }
+    if (FileAction::GetDone(rDone))
+      return true;
+  }
+  return false;
+}
+
+/// Copying a file onto itself must not destroy it.
+/**
+ * \param[in] rDir temporary directory
+ */
+static void test_copy(const std::string& rDir)
+{
+  std::string src(rDir + "/data");
+  std::string alias(rDir + "/alias");
+  FILE* f = fopen(src.c_str(), "w");
+  fputs("payload\n", f);
+  fclose(f);
+  CHECK(link(src.c_str(), alias.c_str()) == 0);
+
+  const char* targets[] = { "data", "alias" };
+  for (size_t i=0; i<2; i++) {
+    std::vector<std::string> args;
+    args.push_back("@copy");
+    args.push_back(src);
+    args.push_back(rDir + "/" + targets[i]);
+    CHECK(FileAction::Submit(-(pid_t) (i + 1), FO_COPY, args, NULL));
+
+    FileActionDone_t done;
+    CHECK(wait_action(done));
+    CHECK(done.id == -(pid_t) (i + 1));
+    CHECK(done.error == EINVAL);
+  }
+
+  struct stat st;
+  CHECK(stat(src.c_str(), &st) == 0 && st.st_size == 8);
+
+  // a regular copy still works
+  std::vector<std::string> args;
+  args.push_back("@copy");
+  args.push_back(src);
+  args.push_back(rDir + "/copy");
+  CHECK(FileAction::Submit(-3, FO_COPY, args, NULL));
+  FileActionDone_t done;
+  CHECK(wait_action(done));
+  CHECK(done.id == -3 && done.error == 0);
+  CHECK(stat((rDir + "/copy").c_str(), &st) == 0 && st.st_size == 8);
+}
+
+/// Writes a token into the notification pipe on SIGCHLD.
+/**
+ * \param[in] signo signal number
+ */
+static void on_sigchld(int /*signo*/)
+{
+  if (write(g_cldPipe[1], "X", 1) <= 0) {}
+}
+
+/// Reads a whole file.
+/**
+ * \param[in] rPath file path
+ * \return file contents (empty if unreadable)
+ */
+static std::string read_file(const std::string& rPath)
+{
+  std::string s;
+  FILE* f = fopen(rPath.c_str(), "r");
+  if (f != NULL) {
+    char buf[256];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+      s.append(buf, n);
+    }
+    fclose(f);
+  }
+  return s;
+}
+
+/// Counts lines in a string.
+/**
+ * \param[in] rS string
+ * \return count of newline characters
+ */
+static size_t count_lines(const std::string& rS)
+{
+  size_t n = 0;
+  for (size_t i=0; i<rS.length(); i++) {
+    if (rS[i] == '\n')
+      n++;
+  }
+  return n;
+}
+
+/// Loads a system table with a single entry.
+/**
+ * \param[in] pEd event dispatcher
+ * \param[in] rName table name
+ * \param[in] rEntry table entry
+ * \return loaded table (to be deleted)
+ */
+static UserTable* load_table(EventDispatcher* pEd, const std::string& rName, const std::string& rEntry)
+{
+  FILE* f = fopen(IncronTab::GetSystemTablePath(rName).c_str(), "w");
+  if (f == NULL) {
+    perror("fopen");
+    exit(1);
+  }
+  fprintf(f, "%s\n", rEntry.c_str());
+  fclose(f);
+
+  UserTable* pUt = new UserTable(pEd, rName, true);
+  pUt->Load();
+  return pUt;
+}
+
+/// Runs the event loop until a file has enough lines.
+/**
+ * The loop keeps running for a moment after that
+ * to catch commands which should not run.
+ * 
+ * \param[in] pEd event dispatcher
+ * \param[in] rOut output file path
+ * \param[in] lines expected count of lines
+ * \return output file contents
+ */
+static std::string run_until(EventDispatcher* pEd, const std::string& rOut, size_t lines)
+{
+  uint64_t deadline = TimerWheel::Now() + 5000;
+  uint64_t settle = 0;
+  for (;;) {
+    uint64_t now = TimerWheel::Now();
+    if (now >= deadline || (settle != 0 && now >= settle))
+      break;
+    if (settle == 0 && count_lines(read_file(rOut)) >= lines)
+      settle = now + 300;
+
+    struct pollfd* pfd = pEd->GetPollData();
+    if (poll(pfd, pEd->GetSize(), 50) > 0 && pEd->ProcessEvents())
+      UserTable::FinishDone();
+  }
+  return read_file(rOut);
+}
+
+/// Creates a watched directory for a dispatcher test.
+/**
+ * \param[in] rDir temporary directory
+ * \param[in] rName test name
+ * \return directory path
+ */
+static std::string make_watched(const std::string& rDir, const std::string& rName)
+{
+  std::string path(rDir + "/w-" + rName);
+  mkdir(path.c_str(), 0755);
+  return path;
+}
+
+/// Commands must not be triggered by their own changes.
+/**
+ * \param[in] rDir temporary directory
+ * \param[in] pEd event dispatcher
+ */
+static void test_loop_avoidance(const std::string& rDir, EventDispatcher* pEd)
+{
+  std::string w(make_watched(rDir, "loop"));
+  std::string out(rDir + "/loop.out");
+  UserTable* pUt = load_table(pEd, "loop", w + " IN_CLOSE_WRITE echo $# >> " + out + "; touch " + w + "/self");
+
+  touch(w + "/a");
+  CHECK(run_until(pEd, out, 1) == "a\n");
+  CHECK(pUt->GetStats().suppressed >= 1);
+
+  delete pUt;
+}
+
+/// Commands sharing a collapse key run at most twice for a burst.
+/**
+ * \param[in] rDir temporary directory
+ * \param[in] pEd event dispatcher
+ */
+static void test_collapse(const std::string& rDir, EventDispatcher* pEd)
+{
+  std::string w(make_watched(rDir, "collapse"));
+  std::string out(rDir + "/collapse.out");
+  UserTable* pUt = load_table(pEd, "collapse", w + " IN_CLOSE_WRITE,loopable=true,collapse=$@ sleep 0.2; echo $# >> " + out);
+
+  touch(w + "/a");
+  touch(w + "/b");
+  touch(w + "/c");
+  touch(w + "/d");
+
+  // the last command follows the last event
+  CHECK(run_until(pEd, out, 2) == "a\nd\n");
+  CHECK(pUt->GetStats().collapsed == 2);
+
+  delete pUt;
+}
+
+/// Commands sharing an ordering key run one after another.
+/**
+ * \param[in] rDir temporary directory
+ * \param[in] pEd event dispatcher
+ */
+static void test_ordered(const std::string& rDir, EventDispatcher* pEd)
+{
+  std::string w(make_watched(rDir, "ordered"));
+  std::string out(rDir + "/ordered.out");
+  UserTable* pUt = load_table(pEd, "ordered", w + " IN_CLOSE_WRITE,loopable=true,ordered=$@ echo start $# >> " + out + "; sleep 0.1; echo end $# >> " + out);
+
+  touch(w + "/a");
+  touch(w + "/b");
+  touch(w + "/c");
+
+  CHECK(run_until(pEd, out, 6) == "start a\nend a\nstart b\nend b\nstart c\nend c\n");
+  CHECK(pUt->GetStats().collapsed == 0);
+
+  delete pUt;
+}
+
+/// Commands over entry rate limits are delayed, dropped or merged.
+/**
+ * \param[in] rDir temporary directory
+ * \param[in] pEd event dispatcher
+ */
+static void test_rate(const std::string& rDir, EventDispatcher* pEd)
+{
+  const char* policies[] = { "delay", "drop", "coalesce" };
+  const char* results[] = { "a\nb\nc\nd\n", "a\n", "a\nd\n" };
+  const size_t lines[] = { 4, 1, 2 };
+
+  for (size_t i=0; i<3; i++) {
+    std::string name(std::string("rate-") + policies[i]);
+    std::string w(make_watched(rDir, name));
+    std::string out(rDir + "/" + name + ".out");
+    UserTable* pUt = load_table(pEd, name, w + " IN_CLOSE_WRITE,loopable=true,rate=10,burst=1,rate_policy=" + policies[i] + " echo $# >> " + out);
+
+    touch(w + "/a");
+    touch(w + "/b");
+    touch(w + "/c");
+    touch(w + "/d");
+
+    CHECK(run_until(pEd, out, lines[i]) == results[i]);
+    CHECK(pUt->GetStats().throttled == 3);
+
+    delete pUt;
+  }
+}
+
+/// Names of events are collected into batches.
+/**
+ * \param[in] rDir temporary directory
+ * \param[in] pEd event dispatcher
+ */
+static void test_batch(const std::string& rDir, EventDispatcher* pEd)
+{
+  std::string w(make_watched(rDir, "batch"));
+  std::string out(rDir + "/batch.out");
+  UserTable* pUt = load_table(pEd, "batch", w + " IN_CLOSE_WRITE,batch=3,batch_time=200 echo >> " + out);
+
+  touch(w + "/a");
+  touch(w + "/b");
+  touch(w + "/c");
+  touch(w + "/d");
+  touch(w + "/e");
+
+  // a full batch runs at once, the rest after the batch time
+  CHECK(run_until(pEd, out, 2) == w + "/a " + w + "/b " + w + "/c\n" + w + "/d " + w + "/e\n");
+
+  delete pUt;
+}
+
+/// Runs the tests driving tables through the event dispatcher.
+/**
+ * \param[in] rDir temporary directory
+ */
+static void test_dispatcher(const std::string& rDir)
+{
+  std::string tabDir(rDir + "/tables");
+  std::string userDir(rDir + "/user");
+  std::string cfg(rDir + "/incron.conf");
+  mkdir(tabDir.c_str(), 0755);
+  mkdir(userDir.c_str(), 0755);
+
+  FILE* f = fopen(cfg.c_str(), "w");
+  fprintf(f, "system_table_dir = %s\nuser_table_dir = %s\n", tabDir.c_str(), userDir.c_str());
+  fclose(f);
+  IncronCfg::Init();
+  IncronCfg::Load(cfg);
+
+  // tables are loaded by the tests, not through management events
+  Inotify in;
+  in.SetNonBlock(true);
+  InotifyWatch stw(tabDir, IN_DELETE_SELF);
+  in.Add(stw);
+  InotifyWatch utw(userDir, IN_DELETE_SELF);
+  in.Add(utw);
+
+  EventDispatcher ed(g_cldPipe[0], &in, &stw, &utw);
+  signal(SIGCHLD, on_sigchld);
+
+  test_loop_avoidance(rDir, &ed);
+  test_collapse(rDir, &ed);
+  test_ordered(rDir, &ed);
+  test_rate(rDir, &ed);
+  test_batch(rDir, &ed);
+
+  signal(SIGCHLD, SIG_DFL);
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+  std::string dir(make_temp_dir());
+
+  if (pipe2(g_cldPipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+    perror("pipe2");
+    return 1;
+  }
+
+  try {
+    test_spill(dir);
+    test_spill_disabled(dir);
+    test_timer_wheel();
+    test_bucket();
+    test_parse_direct();
+    test_compile_shell();
+    test_ordered_option();
+    test_copy(dir);
+    test_dispatcher(dir);
+  } catch (InotifyException& e) {
+    fprintf(stderr, "unexpected exception: %s\n", e.GetMessage().c_str());
+    s_uFailed++;
+  }
+
+  std::string cmd("rm -rf '" + dir + "'");
+  if (system(cmd.c_str()) != 0)
+    fprintf(stderr, "cannot remove %s\n", dir.c_str());
+
+  if (s_uFailed > 0) {
+    fprintf(stderr, "%u check(s) failed\n", s_uFailed);
+    return 1;
+  }
+
+  printf("all tests passed\n");
+  return 0;
+}
@@ -0,0 +1,96 @@
+
+/// inotify cron daemon plugin interface
+/**
+ * \file incron-plugin.h
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ * A plugin is a shared object exporting the functions declared
+ * below with C linkage. It is used by table entries like
+ *
+ *   /some/path IN_CLOSE_WRITE @plugin /usr/lib/incron/example.so ARGUMENT
+ *
+ * The interface only changes together with INCRON_PLUGIN_ABI.
+ */
+
+#ifndef _INCRON_PLUGIN_H_
+#define _INCRON_PLUGIN_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/// Plugin interface version
+#define INCRON_PLUGIN_ABI 1
+
+/// Name of the initialization function
+#define INCRON_PLUGIN_INIT "incron_plugin_init"
+
+/// Name of the event handling function
+#define INCRON_PLUGIN_HANDLE "incron_plugin_handle"
+
+/// Name of the shutdown function
+#define INCRON_PLUGIN_SHUTDOWN "incron_plugin_shutdown"
+
+
+/// Event passed to a plugin
+typedef struct incron_event
+{
+  const char* path;   ///< watched path
+  const char* name;   ///< file name (empty for the watched path itself)
+  uint32_t mask;      ///< inotify event mask
+} incron_event_t;
+
+
+/// Initializes a plugin instance.
+/**
+ * It is called once for each table entry using the plugin.
+ *
+ * \param[in] abi interface version of the daemon (INCRON_PLUGIN_ABI)
+ * \param[in] arg argument given in the table entry (empty if none)
+ * \param[out] ctx instance context passed to the other functions
+ * \return 0 = success, otherwise failure (the entry is disabled)
+ */
+int incron_plugin_init(unsigned abi, const char* arg, void** ctx);
+
+/// Handles an event.
+/**
+ * It must return quickly - events are not processed meanwhile.
+ *
+ * \param[in] ctx instance context
+ * \param[in] evt event (valid only during the call)
+ * \return 0 = success, otherwise failure (it is logged)
+ */
+int incron_plugin_handle(void* ctx, const incron_event_t* evt);
+
+/// Finishes a plugin instance.
+/**
+ * \param[in] ctx instance context
+ */
+void incron_plugin_shutdown(void* ctx);
+
+
+/// Initialization function type
+typedef int (*incron_plugin_init_t)(unsigned, const char*, void**);
+
+/// Event handling function type
+typedef int (*incron_plugin_handle_t)(void*, const incron_event_t*);
+
+/// Shutdown function type
+typedef void (*incron_plugin_shutdown_t)(void*);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_INCRON_PLUGIN_H_
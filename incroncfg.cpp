@@ -44,6 +44,24 @@ void IncronCfg::Init()
   m_defaults.insert(CFG_MAP::value_type("lockfile_dir", "/var/run"));
   m_defaults.insert(CFG_MAP::value_type("lockfile_name", "incrond"));
   m_defaults.insert(CFG_MAP::value_type("editor", ""));
+  m_defaults.insert(CFG_MAP::value_type("backlog_limit", "0"));
+  m_defaults.insert(CFG_MAP::value_type("backlog_spill_dir", "/var/tmp"));
+  m_defaults.insert(CFG_MAP::value_type("read_batch_size", "1048576"));
+  m_defaults.insert(CFG_MAP::value_type("read_batch_time", "10000"));
+  m_defaults.insert(CFG_MAP::value_type("max_jobs", "0"));
+  m_defaults.insert(CFG_MAP::value_type("max_table_jobs", "0"));
+  m_defaults.insert(CFG_MAP::value_type("table_rate", "0"));
+  m_defaults.insert(CFG_MAP::value_type("table_burst", "0"));
+  m_defaults.insert(CFG_MAP::value_type("user_launchers", "yes"));
+  m_defaults.insert(CFG_MAP::value_type("cred_cache_ttl", "300"));
+  m_defaults.insert(CFG_MAP::value_type("batch_manifest_dir", "/tmp"));
+  m_defaults.insert(CFG_MAP::value_type("cgroup_root", ""));
+  m_defaults.insert(CFG_MAP::value_type("cgroup_cpu_max", "0"));
+  m_defaults.insert(CFG_MAP::value_type("cgroup_memory_max", ""));
+  m_defaults.insert(CFG_MAP::value_type("cgroup_io_weight", "0"));
+  m_defaults.insert(CFG_MAP::value_type("job_log_dir", ""));
+  m_defaults.insert(CFG_MAP::value_type("job_log_size", "1048576"));
+  m_defaults.insert(CFG_MAP::value_type("job_log_rotate", "4"));
 }
 
 void IncronCfg::Load(const std::string& rPath)
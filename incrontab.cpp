@@ -20,6 +20,8 @@
 
 #include <sstream>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <errno.h>
 //#include <syslog.h> // TODO remove
 
@@ -32,6 +34,41 @@
 #define CT_LOOPABLE "loopable=true" // no loop is default. loopable must be set
 #define CT_NORECURSION "recursive=false" // recursive is default, no recusion must be set
 #define CT_DOTDIRS "dotdirs=true" // exclude dotdirs is default, include dotdirs must be set
+#define CT_PRIORITY "priority=high" // normal priority is default, high priority must be set
+#define CT_MAXJOBS "max_jobs=" // unlimited is default, a limit must be set
+#define CT_BATCH "batch=" // no batching is default, a batch size must be set
+#define CT_BATCHTIME "batch_time=" // no batching is default, a batch time must be set
+#define CT_BATCHMODE "batch_mode=" // names as arguments is default
+#define CT_BM_ARGV "argv"
+#define CT_BM_STDIN "stdin"
+#define CT_BM_MANIFEST "manifest"
+#define CT_COPROC "coproc=" // a command for each event is default
+#define CT_CP_TSV "tsv"
+#define CT_CP_JSON "json"
+#define CT_ACK "ack=true" // no acknowledgements is default
+#define CT_CPUMAX "cpu_max=" // no limits are default
+#define CT_MEMMAX "memory_max="
+#define CT_IOWEIGHT "io_weight="
+#define CT_TIMEOUT "timeout=" // no time limit is default
+#define CT_KILLAFTER "kill_after="
+#define CT_COOLDOWN "cooldown=" // no cooldown is default
+#define CT_COLLAPSE "collapse=" // no collapsing is default
+#define CT_ORDERED "ordered=" // no ordering is default
+#define CT_OR_FILE "true" // ordering by the file path
+#define CT_OR_FILE_YES "yes"
+#define CT_OR_NONE "false"
+#define CT_OR_NONE_NO "no"
+#define CT_OR_FILE_KEY "$@/$#"
+#define CT_RATE "rate=" // no rate limit is default
+#define CT_BURST "burst="
+#define CT_RATEPOLICY "rate_policy=" // delaying is default
+#define CT_RP_DELAY "delay"
+#define CT_RP_DROP "drop"
+#define CT_RP_COALESCE "coalesce"
+#define CT_NICE "nice=" // inherited scheduling is default
+#define CT_IONICE "ionice="
+#define CT_SCHED "sched="
+#define CT_CPUS "cpus="
 
 
 /*
@@ -53,7 +90,24 @@ IncronTabEntry::IncronTabEntry()
 : m_uMask(0),
   m_fNoLoop(true),
   m_fNoRecursion(false),
-  m_fDotDirs(false)
+  m_fDotDirs(false),
+  m_fPriority(false),
+  m_uMaxJobs(0),
+  m_uBatch(0),
+  m_uBatchTime(0),
+  m_batchMode(BM_ARGV),
+  m_coproc(CP_NONE),
+  m_fAck(false),
+  m_uCpuMax(0),
+  m_uIoWeight(0),
+  m_uTimeout(0),
+  m_uKillAfter(0),
+  m_uCooldown(0),
+  m_rate(0),
+  m_uBurst(0),
+  m_ratePolicy(RP_DELAY),
+  m_fNice(false),
+  m_iNice(0)
 {
   
 }
@@ -61,11 +115,78 @@ IncronTabEntry::IncronTabEntry()
 IncronTabEntry::IncronTabEntry(const std::string& rPath, uint32_t uMask, const std::string& rCmd)
 : m_path(rPath),
   m_uMask(uMask),
-  m_cmd(rCmd)
+  m_cmd(rCmd),
+  m_fNoLoop(true),
+  m_fNoRecursion(false),
+  m_fDotDirs(false),
+  m_fPriority(false),
+  m_uMaxJobs(0),
+  m_uBatch(0),
+  m_uBatchTime(0),
+  m_batchMode(BM_ARGV),
+  m_coproc(CP_NONE),
+  m_fAck(false),
+  m_uCpuMax(0),
+  m_uIoWeight(0),
+  m_uTimeout(0),
+  m_uKillAfter(0),
+  m_uCooldown(0),
+  m_rate(0),
+  m_uBurst(0),
+  m_ratePolicy(RP_DELAY),
+  m_fNice(false),
+  m_iNice(0)
 {
   
 }
 
+/// Appends an option to a mask string.
+/**
+ * \param[in,out] rM mask string (comma separated)
+ * \param[in] rOpt option
+ */
+static void add_option(std::string& rM, const std::string& rOpt)
+{
+  if (!rM.empty())
+    rM.append(",");
+  rM.append(rOpt);
+}
+
+/// Appends a numeric option to a mask string.
+/**
+ * \param[in,out] rM mask string (comma separated)
+ * \param[in] pszName option name (including '=')
+ * \param[in] value option value (0 = default, not written)
+ */
+static void add_option(std::string& rM, const char* pszName, unsigned value)
+{
+  if (value == 0)
+    return;
+  
+  std::ostringstream ss;
+  ss << pszName << value;
+  add_option(rM, ss.str());
+}
+
+/// Checks whether a key template contains a wildcard.
+/**
+ * \param[in] rKey key template
+ * \return true = some wildcard found, false = constant key
+ */
+static bool has_key_wildcard(const std::string& rKey)
+{
+  for (size_t i=0; i+1<rKey.length(); i++) {
+    if (rKey[i] != '$')
+      continue;
+    char c = rKey[i+1];
+    if (c == '@' || c == '#' || c == '%' || c == '&')
+      return true;
+    if (c == '$')
+      i++;
+  }
+  return false;
+}
+
 std::string IncronTabEntry::ToString() const
 {
   std::ostringstream ss;
@@ -79,23 +200,70 @@ std::string IncronTabEntry::ToString() const
 //  else
 //    if (m_fNoLoop) m.append(std::string(","+IN_NO_LOOP_OLD);
 
-  // add CT_NORECURSION artificially
-  if (m.empty())
-    m = m_fNoRecursion ? CT_NORECURSION : m;
-  else
-    if (m_fNoRecursion) m.append(std::string(",")+CT_NORECURSION);
+  // options differing from their defaults are added artificially
+  if (m_fNoRecursion)
+    add_option(m, CT_NORECURSION);
+  if (!m_fNoLoop)
+    add_option(m, CT_LOOPABLE);
+  if (m_fDotDirs)
+    add_option(m, CT_DOTDIRS);
+  if (m_fPriority)
+    add_option(m, CT_PRIORITY);
+  add_option(m, CT_MAXJOBS, m_uMaxJobs);
   
-  // add CT_LOOPABLE artificially
-  if (m.empty())
-    m = !m_fNoLoop ? CT_LOOPABLE : m;
-  else
-    if (!m_fNoLoop) m.append(std::string(",")+CT_LOOPABLE);
+  if (IsBatch()) {
+    add_option(m, CT_BATCH, m_uBatch);
+    add_option(m, CT_BATCHTIME, m_uBatchTime);
+    if (m_batchMode == BM_STDIN)
+      add_option(m, CT_BATCHMODE CT_BM_STDIN);
+    else if (m_batchMode == BM_MANIFEST)
+      add_option(m, CT_BATCHMODE CT_BM_MANIFEST);
+  }
   
-  // add CT_DOTDIRS artificially
-  if (m.empty())
-    m = m_fDotDirs ? CT_DOTDIRS : m;
-  else
-    if (m_fDotDirs) m.append(std::string(",")+CT_DOTDIRS);
+  if (m_coproc != CP_NONE) {
+    add_option(m, m_coproc == CP_JSON ? CT_COPROC CT_CP_JSON : CT_COPROC CT_CP_TSV);
+    if (m_fAck)
+      add_option(m, CT_ACK);
+  }
+  
+  add_option(m, CT_CPUMAX, m_uCpuMax);
+  if (!m_memMax.empty())
+    add_option(m, CT_MEMMAX + m_memMax);
+  add_option(m, CT_IOWEIGHT, m_uIoWeight);
+  
+  if (m_uTimeout > 0) {
+    add_option(m, CT_TIMEOUT, m_uTimeout);
+    add_option(m, CT_KILLAFTER, m_uKillAfter);
+  }
+  
+  add_option(m, CT_COOLDOWN, m_uCooldown);
+  if (!m_collapse.empty())
+    add_option(m, CT_COLLAPSE + m_collapse);
+  if (!m_ordered.empty())
+    add_option(m, CT_ORDERED + m_ordered);
+  
+  if (m_rate > 0) {
+    std::ostringstream ro;
+    ro << CT_RATE << m_rate;
+    add_option(m, ro.str());
+    add_option(m, CT_BURST, m_uBurst);
+    if (m_ratePolicy == RP_DROP)
+      add_option(m, CT_RATEPOLICY CT_RP_DROP);
+    else if (m_ratePolicy == RP_COALESCE)
+      add_option(m, CT_RATEPOLICY CT_RP_COALESCE);
+  }
+  
+  if (m_fNice) {
+    std::ostringstream no;
+    no << CT_NICE << m_iNice;
+    add_option(m, no.str());
+  }
+  if (!m_ionice.empty())
+    add_option(m, CT_IONICE + m_ionice);
+  if (!m_sched.empty())
+    add_option(m, CT_SCHED + m_sched);
+  if (!m_cpus.empty())
+    add_option(m, CT_CPUS + m_cpus);
   
   // fill a default value for broken lines
   if (m.empty())
@@ -138,6 +306,29 @@ bool IncronTabEntry::Parse(const std::string& rStr, IncronTabEntry& rEntry)
   rEntry.m_fNoLoop = true;
   rEntry.m_fNoRecursion = false;
   rEntry.m_fDotDirs = false;
+  rEntry.m_fPriority = false;
+  rEntry.m_uMaxJobs = 0;
+  rEntry.m_uBatch = 0;
+  rEntry.m_uBatchTime = 0;
+  rEntry.m_batchMode = BM_ARGV;
+  rEntry.m_coproc = CP_NONE;
+  rEntry.m_fAck = false;
+  rEntry.m_uCpuMax = 0;
+  rEntry.m_memMax.clear();
+  rEntry.m_uIoWeight = 0;
+  rEntry.m_uTimeout = 0;
+  rEntry.m_uKillAfter = 0;
+  rEntry.m_uCooldown = 0;
+  rEntry.m_collapse.clear();
+  rEntry.m_ordered.clear();
+  rEntry.m_rate = 0;
+  rEntry.m_uBurst = 0;
+  rEntry.m_ratePolicy = RP_DELAY;
+  rEntry.m_fNice = false;
+  rEntry.m_iNice = 0;
+  rEntry.m_ionice.clear();
+  rEntry.m_sched.clear();
+  rEntry.m_cpus.clear();
   
   if (sscanf(s2.c_str(), "%lu", &u) == 1) {
     rEntry.m_uMask = (uint32_t) u;
@@ -154,6 +345,70 @@ bool IncronTabEntry::Parse(const std::string& rStr, IncronTabEntry& rEntry)
         rEntry.m_fNoRecursion = true;
       else if (s == CT_DOTDIRS)
         rEntry.m_fDotDirs = true;
+      else if (s == CT_PRIORITY)
+        rEntry.m_fPriority = true;
+      else if (s.compare(0, strlen(CT_MAXJOBS), CT_MAXJOBS) == 0)
+        rEntry.m_uMaxJobs = (unsigned) strtoul(s.c_str() + strlen(CT_MAXJOBS), NULL, 10);
+      else if (s.compare(0, strlen(CT_BATCH), CT_BATCH) == 0)
+        rEntry.m_uBatch = (unsigned) strtoul(s.c_str() + strlen(CT_BATCH), NULL, 10);
+      else if (s.compare(0, strlen(CT_BATCHTIME), CT_BATCHTIME) == 0)
+        rEntry.m_uBatchTime = (unsigned) strtoul(s.c_str() + strlen(CT_BATCHTIME), NULL, 10);
+      else if (s == CT_BATCHMODE CT_BM_ARGV)
+        rEntry.m_batchMode = BM_ARGV;
+      else if (s == CT_BATCHMODE CT_BM_STDIN)
+        rEntry.m_batchMode = BM_STDIN;
+      else if (s == CT_BATCHMODE CT_BM_MANIFEST)
+        rEntry.m_batchMode = BM_MANIFEST;
+      else if (s == CT_COPROC CT_CP_TSV)
+        rEntry.m_coproc = CP_TSV;
+      else if (s == CT_COPROC CT_CP_JSON)
+        rEntry.m_coproc = CP_JSON;
+      else if (s == CT_ACK)
+        rEntry.m_fAck = true;
+      else if (s.compare(0, strlen(CT_CPUMAX), CT_CPUMAX) == 0)
+        rEntry.m_uCpuMax = (unsigned) strtoul(s.c_str() + strlen(CT_CPUMAX), NULL, 10);
+      else if (s.compare(0, strlen(CT_MEMMAX), CT_MEMMAX) == 0)
+        rEntry.m_memMax = s.substr(strlen(CT_MEMMAX));
+      else if (s.compare(0, strlen(CT_IOWEIGHT), CT_IOWEIGHT) == 0)
+        rEntry.m_uIoWeight = (unsigned) strtoul(s.c_str() + strlen(CT_IOWEIGHT), NULL, 10);
+      else if (s.compare(0, strlen(CT_TIMEOUT), CT_TIMEOUT) == 0)
+        rEntry.m_uTimeout = (unsigned) strtoul(s.c_str() + strlen(CT_TIMEOUT), NULL, 10);
+      else if (s.compare(0, strlen(CT_KILLAFTER), CT_KILLAFTER) == 0)
+        rEntry.m_uKillAfter = (unsigned) strtoul(s.c_str() + strlen(CT_KILLAFTER), NULL, 10);
+      else if (s.compare(0, strlen(CT_COOLDOWN), CT_COOLDOWN) == 0)
+        rEntry.m_uCooldown = (unsigned) strtoul(s.c_str() + strlen(CT_COOLDOWN), NULL, 10);
+      else if (s.compare(0, strlen(CT_COLLAPSE), CT_COLLAPSE) == 0)
+        rEntry.m_collapse = s.substr(strlen(CT_COLLAPSE));
+      else if (s == CT_ORDERED CT_OR_FILE || s == CT_ORDERED CT_OR_FILE_YES)
+        rEntry.m_ordered = CT_OR_FILE_KEY;
+      else if (s == CT_ORDERED CT_OR_NONE || s == CT_ORDERED CT_OR_NONE_NO)
+        rEntry.m_ordered.clear();
+      else if (s.compare(0, strlen(CT_ORDERED), CT_ORDERED) == 0) {
+        // a constant key would serialize all commands of the entry
+        rEntry.m_ordered = s.substr(strlen(CT_ORDERED));
+        if (!has_key_wildcard(rEntry.m_ordered))
+          return false;
+      }
+      else if (s.compare(0, strlen(CT_RATE), CT_RATE) == 0)
+        rEntry.m_rate = strtod(s.c_str() + strlen(CT_RATE), NULL);
+      else if (s.compare(0, strlen(CT_BURST), CT_BURST) == 0)
+        rEntry.m_uBurst = (unsigned) strtoul(s.c_str() + strlen(CT_BURST), NULL, 10);
+      else if (s == CT_RATEPOLICY CT_RP_DELAY)
+        rEntry.m_ratePolicy = RP_DELAY;
+      else if (s == CT_RATEPOLICY CT_RP_DROP)
+        rEntry.m_ratePolicy = RP_DROP;
+      else if (s == CT_RATEPOLICY CT_RP_COALESCE)
+        rEntry.m_ratePolicy = RP_COALESCE;
+      else if (s.compare(0, strlen(CT_NICE), CT_NICE) == 0) {
+        rEntry.m_fNice = true;
+        rEntry.m_iNice = (int) strtol(s.c_str() + strlen(CT_NICE), NULL, 10);
+      }
+      else if (s.compare(0, strlen(CT_IONICE), CT_IONICE) == 0)
+        rEntry.m_ionice = s.substr(strlen(CT_IONICE));
+      else if (s.compare(0, strlen(CT_SCHED), CT_SCHED) == 0)
+        rEntry.m_sched = s.substr(strlen(CT_SCHED));
+      else if (s.compare(0, strlen(CT_CPUS), CT_CPUS) == 0)
+        rEntry.m_cpus = s.substr(strlen(CT_CPUS));
       else
         rEntry.m_uMask |= InotifyEvent::GetMaskByName(s);
     }
@@ -164,22 +419,24 @@ bool IncronTabEntry::Parse(const std::string& rStr, IncronTabEntry& rEntry)
 
 std::string IncronTabEntry::GetSafePath(const std::string& rPath)
 {
-  std::ostringstream stream;
-  
-  SIZE len = rPath.length();
-  for (SIZE i = 0; i < len; i++) {
-    if (rPath[i] == ' ') {
-      stream << "\\ ";
-    }
-    else if (rPath[i] == '\\') {
-      stream << "\\\\";
-    }
-    else {
-      stream << rPath[i];
-    }
+  std::string s;
+  AppendSafePath(rPath, s);
+  return s;
+}
+
+void IncronTabEntry::AppendSafePath(const std::string& rPath, std::string& rOut)
+{
+  // unaffected parts are copied at once
+  size_t oldpos = 0;
+  size_t pos;
+  while ((pos = rPath.find_first_of(" \\", oldpos)) != std::string::npos) {
+    rOut.append(rPath, oldpos, pos - oldpos);
+    rOut.push_back('\\');
+    rOut.push_back(rPath[pos]);
+    oldpos = pos + 1;
   }
   
-  return stream.str();
+  rOut.append(rPath, oldpos, std::string::npos);
 }
 
 bool IncronTab::Load(const std::string& rPath)
@@ -23,6 +23,30 @@
 
 #include "strtok.h"
 
+/// Batch modes (how accumulated file names are passed)
+typedef enum
+{
+  BM_ARGV,      ///< additional arguments
+  BM_STDIN,     ///< NUL separated list on standard input
+  BM_MANIFEST   ///< manifest file (one name per line) passed as the last argument
+} BatchMode_t;
+
+/// Coprocess modes (how events are passed to a persistent handler)
+typedef enum
+{
+  CP_NONE,      ///< no coprocess (a command for each event)
+  CP_TSV,       ///< tab separated lines
+  CP_JSON       ///< JSON lines
+} CoprocMode_t;
+
+/// Rate limiting policies (what happens to jobs over the limit)
+typedef enum
+{
+  RP_DELAY,     ///< delayed until the rate allows them
+  RP_DROP,      ///< dropped
+  RP_COALESCE   ///< merged into the delayed one (only the newest is kept)
+} RatePolicy_t;
+
 /// Incron table entry class.
 class IncronTabEntry
 {
@@ -118,6 +142,269 @@ public:
     return m_fDotDirs;
   }
   
+  /// Checks whether this entry has high priority.
+  /**
+   * Events of high priority entries are dispatched before
+   * all other events.
+   * 
+   * \return true = high priority, false = normal priority
+   */
+  inline bool IsPriority() const
+  {
+    return m_fPriority;
+  }
+  
+  /// Returns the maximum count of running commands.
+  /**
+   * The limit applies to the entry including all its
+   * subdirectory entries.
+   * 
+   * \return maximum count of commands (0 = unlimited)
+   */
+  inline unsigned GetMaxJobs() const
+  {
+    return m_uMaxJobs;
+  }
+  
+  /// Returns the maximum count of events in a batch.
+  /**
+   * \return maximum count of events (0 = unlimited)
+   */
+  inline unsigned GetBatchSize() const
+  {
+    return m_uBatch;
+  }
+  
+  /// Returns the maximum time for accumulating a batch.
+  /**
+   * \return time in milliseconds (0 = default)
+   */
+  inline unsigned GetBatchTime() const
+  {
+    return m_uBatchTime;
+  }
+  
+  /// Returns the batch mode.
+  /**
+   * \return batch mode
+   */
+  inline BatchMode_t GetBatchMode() const
+  {
+    return m_batchMode;
+  }
+  
+  /// Checks whether events of this entry are processed in batches.
+  /**
+   * \return true = batches, false = single events
+   */
+  inline bool IsBatch() const
+  {
+    return m_uBatch > 0 || m_uBatchTime > 0;
+  }
+  
+  /// Returns the coprocess mode.
+  /**
+   * \return coprocess mode
+   */
+  inline CoprocMode_t GetCoprocMode() const
+  {
+    return m_coproc;
+  }
+  
+  /// Checks whether the coprocess acknowledges processed events.
+  /**
+   * \return true = acknowledgements, false = no acknowledgements
+   */
+  inline bool IsAck() const
+  {
+    return m_fAck;
+  }
+  
+  /// Returns the CPU limit of the entry's commands.
+  /**
+   * \return limit in percents of one CPU (0 = unlimited)
+   */
+  inline unsigned GetCpuMax() const
+  {
+    return m_uCpuMax;
+  }
+  
+  /// Returns the memory limit of the entry's commands.
+  /**
+   * \return limit in cgroup syntax, e.g. "512M" (empty = unlimited)
+   */
+  inline const std::string& GetMemoryMax() const
+  {
+    return m_memMax;
+  }
+  
+  /// Returns the I/O weight of the entry's commands.
+  /**
+   * \return weight (1-10000; 0 = default)
+   */
+  inline unsigned GetIoWeight() const
+  {
+    return m_uIoWeight;
+  }
+  
+  /// Checks whether the entry's commands have resource limits.
+  /**
+   * \return true = limits, false = no limits
+   */
+  inline bool HasLimits() const
+  {
+    return m_uCpuMax > 0 || !m_memMax.empty() || m_uIoWeight > 0;
+  }
+  
+  /// Returns the time limit of the entry's commands.
+  /**
+   * Commands running longer are terminated (SIGTERM
+   * to their process groups).
+   * 
+   * \return time limit in seconds (0 = unlimited)
+   */
+  inline unsigned GetTimeout() const
+  {
+    return m_uTimeout;
+  }
+  
+  /// Returns the time between terminating and killing a command.
+  /**
+   * \return time in seconds (0 = default)
+   */
+  inline unsigned GetKillAfter() const
+  {
+    return m_uKillAfter;
+  }
+  
+  /// Returns the loop avoidance cooldown.
+  /**
+   * Events are still suppressed for this time after
+   * the last command of a watch finishes.
+   * 
+   * \return time in milliseconds (0 = none)
+   */
+  inline unsigned GetCooldown() const
+  {
+    return m_uCooldown;
+  }
+  
+  /// Returns the collapsing key template.
+  /**
+   * Commands with the same expanded key are collapsed
+   * (at most one runs and one waits).
+   * 
+   * \return key template (with wildcards; empty = no collapsing)
+   */
+  inline const std::string& GetCollapseKey() const
+  {
+    return m_collapse;
+  }
+  
+  /// Returns the ordering key template.
+  /**
+   * Commands with the same expanded key run one after
+   * another in the event order.
+   * 
+   * \return key template (with wildcards; empty = no ordering)
+   */
+  inline const std::string& GetOrderKey() const
+  {
+    return m_ordered;
+  }
+  
+  /// Returns the rate limit of the entry's commands.
+  /**
+   * \return commands per second (0 = unlimited)
+   */
+  inline double GetRate() const
+  {
+    return m_rate;
+  }
+  
+  /// Returns the burst size of the entry's commands.
+  /**
+   * \return count of commands (0 = default)
+   */
+  inline unsigned GetBurst() const
+  {
+    return m_uBurst;
+  }
+  
+  /// Returns the rate limiting policy.
+  /**
+   * \return policy
+   */
+  inline RatePolicy_t GetRatePolicy() const
+  {
+    return m_ratePolicy;
+  }
+  
+  /// Checks whether the nice value of the entry's commands is set.
+  /**
+   * \return true = set, false = inherited
+   */
+  inline bool HasNice() const
+  {
+    return m_fNice;
+  }
+  
+  /// Returns the nice value of the entry's commands.
+  /**
+   * \return nice value (-20 to 19)
+   */
+  inline int GetNice() const
+  {
+    return m_iNice;
+  }
+  
+  /// Returns the I/O scheduling class of the entry's commands.
+  /**
+   * \return class and level, e.g. "be:7" (empty = inherited)
+   */
+  inline const std::string& GetIoNice() const
+  {
+    return m_ionice;
+  }
+  
+  /// Returns the CPU scheduling policy of the entry's commands.
+  /**
+   * \return policy ("batch" or "idle"; empty = inherited)
+   */
+  inline const std::string& GetSched() const
+  {
+    return m_sched;
+  }
+  
+  /// Returns the CPUs the entry's commands may run on.
+  /**
+   * \return CPU list, e.g. "0-3+6" (empty = inherited)
+   */
+  inline const std::string& GetCpus() const
+  {
+    return m_cpus;
+  }
+  
+  /// Checks whether the entry's commands have scheduling attributes.
+  /**
+   * \return true = attributes, false = no attributes
+   */
+  inline bool HasSched() const
+  {
+    return m_fNice || !m_ionice.empty() || !m_sched.empty() || !m_cpus.empty();
+  }
+  
+  /// Sets the watch filesystem path.
+  /**
+   * It is used for deriving entries for subdirectories.
+   * 
+   * \param[in] rPath watch path
+   */
+  inline void SetPath(const std::string& rPath)
+  {
+    m_path = rPath;
+  }
+  
   /// Add backslashes before spaces in the source path.
   /**
    * It also adds backslashes before all original backslashes
@@ -133,6 +420,15 @@ public:
    */
   static std::string GetSafePath(const std::string& rPath);
   
+  /// Appends a path with backslashes before spaces (and backslashes).
+  /**
+   * It works like GetSafePath() but appends to an existing string.
+   * 
+   * \param[in] rPath path to be modified
+   * \param[out] rOut output string
+   */
+  static void AppendSafePath(const std::string& rPath, std::string& rOut);
+  
 protected:
   std::string m_path; ///< watch path
   uint32_t m_uMask;   ///< event mask
@@ -140,6 +436,29 @@ protected:
   bool m_fNoLoop;     ///< no loop yes/no
   bool m_fNoRecursion;///< no recursion yes/no
   bool m_fDotDirs;    ///< dotdir included yes/no
+  bool m_fPriority;   ///< high priority yes/no
+  unsigned m_uMaxJobs;///< maximum count of running commands (0 = unlimited)
+  unsigned m_uBatch;  ///< maximum count of events in a batch (0 = unlimited)
+  unsigned m_uBatchTime;  ///< maximum batch accumulation time (ms)
+  BatchMode_t m_batchMode;  ///< batch mode
+  CoprocMode_t m_coproc;    ///< coprocess mode
+  bool m_fAck;        ///< coprocess acknowledgements yes/no
+  unsigned m_uCpuMax; ///< CPU limit (percents; 0 = unlimited)
+  std::string m_memMax;   ///< memory limit (empty = unlimited)
+  unsigned m_uIoWeight;   ///< I/O weight (0 = default)
+  unsigned m_uTimeout;    ///< time limit (s; 0 = unlimited)
+  unsigned m_uKillAfter;  ///< time between SIGTERM and SIGKILL (s; 0 = default)
+  unsigned m_uCooldown;   ///< loop avoidance cooldown (ms)
+  std::string m_collapse; ///< collapsing key template (empty = none)
+  std::string m_ordered;  ///< ordering key template (empty = none)
+  double m_rate;          ///< rate limit (commands per second; 0 = unlimited)
+  unsigned m_uBurst;      ///< burst size (0 = default)
+  RatePolicy_t m_ratePolicy;  ///< rate limiting policy
+  bool m_fNice;           ///< nice value set yes/no
+  int m_iNice;            ///< nice value
+  std::string m_ionice;   ///< I/O scheduling class (empty = inherited)
+  std::string m_sched;    ///< CPU scheduling policy (empty = inherited)
+  std::string m_cpus;     ///< CPU list (empty = inherited)
 };
 
 
@@ -199,6 +518,17 @@ public:
     return m_tab[index];
   }
   
+  /// Returns an entry (read-only).
+  /**
+   * \return reference to the entry for the given index
+   * 
+   * \attention This method doesn't test index bounds.
+   */
+  inline const IncronTabEntry& GetEntry(int index) const
+  {
+    return m_tab[index];
+  }
+  
   /// Loads the table.
   /**
    * \param[in] rPath path to a source table file
@@ -26,8 +26,12 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
 #include <cstdio>
-//#include <syslog.h> // TODO remove
+#include <cstdlib>
+#include <cstring>
+#include <syslog.h>
 
 #include "inotify-cxx.h"
 #pragma GCC diagnostic ignored "-Wpedantic"  // inotify-cxx is not pedantic
@@ -299,6 +303,17 @@ void InotifyWatch::__Disable()
 
 
 Inotify::Inotify() throw (InotifyException)
+: m_buf(INOTIFY_BUFLEN),
+  m_uBatchBytes(0),
+  m_uBatchUsec(0),
+  m_uSmallReads(0),
+  m_uBacklogLimit(0),
+  m_spillFd(-1),
+  m_spillRd(0),
+  m_spillWr(0),
+  m_uSpillCount(0),
+  m_uLostCount(0),
+  m_uSpillSerial(0)
 {
   IN_LOCK_INIT
   
@@ -326,6 +341,14 @@ void Inotify::Close()
     m_fd = -1;
   }
   
+  if (m_spillFd != -1) {
+    close(m_spillFd);
+    m_spillFd = -1;
+  }
+  m_spillRd = m_spillWr = 0;
+  m_uSpillCount = 0;
+  ForgetSpilled();
+  
   IN_WRITE_END
 }
 
@@ -393,6 +416,9 @@ void Inotify::Remove(InotifyWatch* pWatch) throw (InotifyException)
     throw InotifyException(IN_EXC_MSG("invalid file descriptor"), EBUSY, this);
   }
   
+  // queued events must not outlive the watch
+  DropEvents(pWatch);
+  
   // for enabled watch
   if (pWatch->m_wd != -1) {  
     
@@ -423,48 +449,108 @@ void Inotify::RemoveAll()
       pW->m_wd = -1;
     }
     pW->m_pInotify = NULL;
+    pW->m_uSpillId = 0;
     it++;
   }
   
   m_watches.clear();
   m_paths.clear();
+  m_events.clear();
+  m_fastEvents.clear();
+  m_spillWatches.clear();
   
   IN_WRITE_END
 }
 
 void Inotify::WaitForEvents(bool fNoIntr) throw (InotifyException)
 {
-  ssize_t len = 0;
-  
-  do {
-    len = read(m_fd, m_buf, INOTIFY_BUFLEN);
-  } while (fNoIntr && len == -1 && errno == EINTR);
+  struct timespec start;
+  if (m_uBatchUsec > 0)
+    clock_gettime(CLOCK_MONOTONIC, &start);
   
-  if (len == -1 && !(errno == EWOULDBLOCK || errno == EINTR))
-    throw InotifyException(IN_EXC_MSG("reading events failed"), errno, this);
-  
-  if (len == -1)
-    return;
-  
-  IN_WRITE_BEGIN
+  size_t total = 0;
+  size_t want = m_buf.size();
   
-  ssize_t i = 0;
-  while (i < len) {
-    struct inotify_event* pEvt = (struct inotify_event*) &m_buf[i];
-    InotifyWatch* pW = FindWatch(pEvt->wd);
-    if (pW != NULL) {
-      InotifyEvent evt(pEvt, pW);
-      if (    InotifyEvent::IsType(pW->GetMask(), IN_ONESHOT)
-          ||  InotifyEvent::IsType(evt.GetMask(), IN_IGNORED))
-        pW->__Disable();
-      m_events.push_back(evt);
+  for (;;) {
+    if (want > m_buf.size())
+      m_buf.resize(want);
+    
+    ssize_t len = 0;
+    
+    do {
+      len = read(m_fd, &m_buf[0], want);
+    } while (fNoIntr && len == -1 && errno == EINTR);
+    
+    if (len == -1 && !(errno == EWOULDBLOCK || errno == EINTR))
+      throw InotifyException(IN_EXC_MSG("reading events failed"), errno, this);
+    
+    if (len == -1)
+      break;
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t t = ((uint64_t) ts.tv_sec) * 1000000 + ((uint64_t) ts.tv_nsec) / 1000;
+    
+    IN_WRITE_BEGIN
+    
+    ssize_t i = 0;
+    while (i < len) {
+      struct inotify_event* pEvt = (struct inotify_event*) &m_buf[i];
+      InotifyWatch* pW = FindWatch(pEvt->wd);
+      if (pW != NULL) {
+        InotifyEvent evt(pEvt, pW, t);
+        if (    InotifyEvent::IsType(pW->GetMask(), IN_ONESHOT)
+            ||  InotifyEvent::IsType(evt.GetMask(), IN_IGNORED))
+          pW->__Disable();
+        PushEvent(evt);
+      }
+      i += INOTIFY_EVENT_SIZE + (ssize_t) pEvt->len;
+    }
+    
+    IN_WRITE_END
+    
+    total += (size_t) len;
+    
+    // the buffer wasn't full - the kernel queue has been drained
+    if ((size_t) len + INOTIFY_MAX_EVENT_SIZE <= want)
+      break;
+    
+    if (m_uBatchBytes > 0 && total >= m_uBatchBytes)
+      break;
+    
+    if (m_uBatchUsec > 0) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      long usec = (now.tv_sec - start.tv_sec) * 1000000L + (now.tv_nsec - start.tv_nsec) / 1000L;
+      if (usec >= (long) m_uBatchUsec)
+        break;
+    }
+    
+    // size the next read by the amount of pending data
+    int avail = 0;
+    if (ioctl(m_fd, FIONREAD, &avail) == -1 || avail <= 0)
+      break;
+    
+    want = (size_t) avail;
+    if (m_uBatchBytes > 0 && want > m_uBatchBytes - total)
+      want = m_uBatchBytes - total;
+    if (want > INOTIFY_MAXBUFLEN)
+      want = INOTIFY_MAXBUFLEN;
+    if (want < INOTIFY_BUFLEN)
+      want = INOTIFY_BUFLEN;
+  }
+  
+  // a grown buffer is halved when bursts are over
+  if (m_buf.size() > INOTIFY_BUFLEN) {
+    m_uSmallReads = total <= m_buf.size() / 4 ? m_uSmallReads + 1 : 0;
+    if (m_uSmallReads >= INOTIFY_SHRINK_READS) {
+      size_t size = m_buf.size() / 2;
+      std::vector<unsigned char>(size > INOTIFY_BUFLEN ? size : INOTIFY_BUFLEN).swap(m_buf);
+      m_uSmallReads = 0;
     }
-    i += INOTIFY_EVENT_SIZE + (ssize_t) pEvt->len;
   }
-  
-  IN_WRITE_END
 }
-  
+
 bool Inotify::GetEvent(InotifyEvent* pEvt) throw (InotifyException)
 {
   if (pEvt == NULL)
@@ -472,7 +558,18 @@ bool Inotify::GetEvent(InotifyEvent* pEvt) throw (InotifyException)
   
   IN_WRITE_BEGIN
   
-  bool b = !m_events.empty();
+  bool b = !m_fastEvents.empty();
+  if (b) {
+    *pEvt = m_fastEvents.front();
+    m_fastEvents.pop_front();
+    IN_WRITE_END
+    return b;
+  }
+  
+  if (m_events.empty() && m_uSpillCount > 0)
+    Unspill();
+  
+  b = !m_events.empty();
   if (b) {
     *pEvt = m_events.front();
     m_events.pop_front();
@@ -482,24 +579,223 @@ bool Inotify::GetEvent(InotifyEvent* pEvt) throw (InotifyException)
     
   return b;
 }
+
+bool Inotify::GetPriorityEvent(InotifyEvent& rEvt)
+{
+  IN_WRITE_BEGIN
+  
+  bool b = !m_fastEvents.empty();
+  if (b) {
+    rEvt = m_fastEvents.front();
+    m_fastEvents.pop_front();
+  }
+  
+  IN_WRITE_END
+  
+  return b;
+}
   
 bool Inotify::PeekEvent(InotifyEvent* pEvt) throw (InotifyException)
 {
   if (pEvt == NULL)
     throw InotifyException(IN_EXC_MSG("null pointer to event"), EINVAL, this);
   
-  IN_READ_BEGIN
+  IN_WRITE_BEGIN
+  
+  if (!m_fastEvents.empty()) {
+    *pEvt = m_fastEvents.front();
+    IN_WRITE_END
+    return true;
+  }
+  
+  if (m_events.empty() && m_uSpillCount > 0)
+    Unspill();
   
   bool b = !m_events.empty();
   if (b) {
     *pEvt = m_events.front();
   }
   
-  IN_READ_END
+  IN_WRITE_END
   
   return b;
 }
 
+void Inotify::SetBacklogLimit(size_t uLimit, const std::string& rSpillDir)
+{
+  IN_WRITE_BEGIN
+  
+  m_uBacklogLimit = uLimit;
+  m_spillDir = rSpillDir;
+  
+  IN_WRITE_END
+}
+
+void Inotify::PushEvent(const InotifyEvent& rEvt)
+{
+  if (rEvt.m_pWatch != NULL && rEvt.m_pWatch->IsPriority()) {
+    m_fastEvents.push_back(rEvt);
+    return;
+  }
+  
+  // keep the order - once spilling starts everything goes to the file
+  if (m_uBacklogLimit > 0 && (m_uSpillCount > 0 || m_events.size() >= m_uBacklogLimit)) {
+    if (SpillEvent(rEvt))
+      return;
+    
+    // it would overtake the spilled events
+    if (m_uSpillCount > 0) {
+      m_uLostCount++;
+      return;
+    }
+  }
+  
+  m_events.push_back(rEvt);
+}
+
+bool Inotify::SpillEvent(const InotifyEvent& rEvt)
+{
+  if (m_spillFd == -1) {
+    if (m_spillDir.empty())
+      return false;
+      
+#ifdef O_TMPFILE
+    m_spillFd = open(m_spillDir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif // O_TMPFILE
+    if (m_spillFd == -1) {
+      std::string tmpl(m_spillDir + "/.incron-spill-XXXXXX");
+      m_spillFd = mkstemp(&tmpl[0]);
+      if (m_spillFd == -1)
+        return false;
+      unlink(tmpl.c_str());
+      fcntl(m_spillFd, F_SETFD, FD_CLOEXEC);
+    }
+    m_spillRd = m_spillWr = 0;
+  }
+  
+  // records refer to watches by own identifiers - watch descriptors
+  // are gone as soon as a watch is disabled (IN_IGNORED, IN_ONESHOT)
+  InotifyWatch* pW = rEvt.m_pWatch;
+  if (pW != NULL && pW->m_uSpillId == 0) {
+    if (++m_uSpillSerial == 0)
+      m_uSpillSerial = 1;
+    pW->m_uSpillId = m_uSpillSerial;
+    m_spillWatches.insert(IN_SPILL_MAP::value_type(pW->m_uSpillId, pW));
+  }
+  
+  uint32_t hdr[6];
+  hdr[0] = pW != NULL ? pW->m_uSpillId : 0;
+  hdr[1] = rEvt.GetMask();
+  hdr[2] = rEvt.GetCookie();
+  hdr[3] = rEvt.GetLength();
+  memcpy(&hdr[4], &rEvt.m_uTime, sizeof(uint64_t));
+  
+  std::string rec((const char*) hdr, INOTIFY_SPILL_HDRLEN);
+  rec.append(rEvt.GetName());
+  
+  ssize_t len = pwrite(m_spillFd, rec.data(), rec.length(), m_spillWr);
+  if (len != (ssize_t) rec.length())
+    return false; // a partial record is overwritten next time
+  
+  m_spillWr += len;
+  m_uSpillCount++;
+  return true;
+}
+
+void Inotify::Unspill()
+{
+  unsigned char buf[INOTIFY_BUFLEN];
+  bool fDamaged = false;
+  
+  while (m_uSpillCount > 0 && (m_uBacklogLimit == 0 || m_events.size() < m_uBacklogLimit)) {
+    ssize_t len = pread(m_spillFd, buf, INOTIFY_BUFLEN, m_spillRd);
+    if (len == -1 && errno == EINTR)
+      continue;
+    if (len < (ssize_t) INOTIFY_SPILL_HDRLEN) {
+      fDamaged = true; // short file or read error
+      break;
+    }
+    
+    ssize_t i = 0;
+    while (     m_uSpillCount > 0
+            &&  (m_uBacklogLimit == 0 || m_events.size() < m_uBacklogLimit)
+            &&  i + (ssize_t) INOTIFY_SPILL_HDRLEN <= len)
+    {
+      uint32_t hdr[6];
+      memcpy(hdr, &buf[i], INOTIFY_SPILL_HDRLEN);
+      ssize_t reclen = (ssize_t) INOTIFY_SPILL_HDRLEN + (ssize_t) hdr[3];
+      if (i + reclen > len)
+        break;
+      
+      // the watch may be gone meanwhile - drop its events
+      IN_SPILL_MAP::iterator it = m_spillWatches.find(hdr[0]);
+      if (it != m_spillWatches.end()) {
+        InotifyWatch* pW = (*it).second;
+        InotifyEvent evt;
+        evt.m_uMask = hdr[1];
+        evt.m_uCookie = hdr[2];
+        memcpy(&evt.m_uTime, &hdr[4], sizeof(uint64_t));
+        evt.m_name.assign((const char*) &buf[i + INOTIFY_SPILL_HDRLEN], hdr[3]);
+        evt.m_pWatch = pW;
+        m_events.push_back(evt);
+      }
+      
+      i += reclen;
+      m_uSpillCount--;
+    }
+    
+    if (i == 0) {
+      fDamaged = true; // a record doesn't fit
+      break;
+    }
+    
+    m_spillRd += i;
+  }
+  
+  // the remaining records cannot be read back
+  if (m_uSpillCount > 0 && (fDamaged || m_spillRd >= m_spillWr)) {
+    syslog(LOG_ERR, "cannot read spilled events back, %lu events lost", (unsigned long) m_uSpillCount);
+    m_uLostCount += m_uSpillCount;
+    m_uSpillCount = 0;
+  }
+  
+  // the file is exhausted - truncate it
+  if (m_uSpillCount == 0) {
+    ForgetSpilled();
+    m_spillRd = m_spillWr = 0;
+    if (ftruncate(m_spillFd, 0) != 0) {
+      close(m_spillFd);
+      m_spillFd = -1;
+    }
+  }
+}
+
+void Inotify::DropEvents(InotifyWatch* pWatch)
+{
+  if (pWatch->m_uSpillId != 0) {
+    m_spillWatches.erase(pWatch->m_uSpillId);
+    pWatch->m_uSpillId = 0;
+  }
+  
+  std::deque<InotifyEvent>* queues[2] = { &m_events, &m_fastEvents };
+  for (int i=0; i<2; i++) {
+    std::deque<InotifyEvent>::iterator out = queues[i]->begin();
+    for (std::deque<InotifyEvent>::iterator it = queues[i]->begin(); it != queues[i]->end(); it++) {
+      if ((*it).m_pWatch != pWatch)
+        *out++ = *it;
+    }
+    queues[i]->erase(out, queues[i]->end());
+  }
+}
+
+void Inotify::ForgetSpilled()
+{
+  for (IN_SPILL_MAP::iterator it = m_spillWatches.begin(); it != m_spillWatches.end(); it++) {
+    (*it).second->m_uSpillId = 0;
+  }
+  m_spillWatches.clear();
+}
+
 InotifyWatch* Inotify::FindWatch(int iDescriptor)
 {
   IN_READ_BEGIN
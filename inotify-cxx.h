@@ -30,6 +30,8 @@
 #include <string>
 #include <deque>
 #include <map>
+#include <vector>
+#include <sys/types.h>
 
 // Please ensure that the following headers take the right place
 #include <sys/syscall.h>
@@ -46,6 +48,18 @@
 /// Event buffer length
 #define INOTIFY_BUFLEN (1024 * (INOTIFY_EVENT_SIZE + 16))
 
+/// Maximum event buffer length (the buffer grows on demand)
+#define INOTIFY_MAXBUFLEN (64 * INOTIFY_BUFLEN)
+
+/// Count of calls reading little data after which a grown buffer shrinks
+#define INOTIFY_SHRINK_READS 32
+
+/// Maximum size of one event (with the longest name)
+#define INOTIFY_MAX_EVENT_SIZE (INOTIFY_EVENT_SIZE + 256)
+
+/// Spilled event record header size (watch descriptor, mask, cookie, name length, time)
+#define INOTIFY_SPILL_HDRLEN (6 * sizeof(uint32_t))
+
 /// Helper macro for creating exception messages.
 /**
  * It prepends the message by the function name.
@@ -227,7 +241,8 @@ public:
    */
   InotifyEvent()
   : m_uMask(0),
-    m_uCookie(0)
+    m_uCookie(0),
+    m_uTime(0)
   {
     m_pWatch = NULL;
   }
@@ -239,10 +254,12 @@ public:
    * 
    * \param[in] pEvt event data
    * \param[in] pWatch inotify watch
+   * \param[in] uTime reception time (see GetTime())
    */
-  InotifyEvent(const struct inotify_event* pEvt, InotifyWatch* pWatch)
+  InotifyEvent(const struct inotify_event* pEvt, InotifyWatch* pWatch, uint64_t uTime = 0)
   : m_uMask(0),
-    m_uCookie(0)
+    m_uCookie(0),
+    m_uTime(uTime)
   {
     if (pEvt != NULL) {
       m_uMask = (uint32_t) pEvt->mask;
@@ -307,6 +324,17 @@ public:
     return m_uCookie;
   }
   
+  /// Returns the event reception time.
+  /**
+   * It is the time when the event was read from the kernel.
+   * 
+   * \return monotonic time in microseconds (0 = unknown)
+   */
+  inline uint64_t GetTime() const
+  {
+    return m_uTime;
+  }
+  
   /// Returns the event name length.
   /**
    * \return event name length
@@ -364,8 +392,11 @@ public:
   void DumpTypes(std::string& rStr) const;
   
 private:
+  friend class Inotify;
+
   uint32_t m_uMask;           ///< mask
   uint32_t m_uCookie;         ///< cookie
+  uint64_t m_uTime;           ///< reception time
   std::string m_name;         ///< name
   InotifyWatch* m_pWatch;     ///< source watch
 };
@@ -395,7 +426,9 @@ public:
   : m_path(rPath),
     m_uMask(uMask),
     m_wd((int32_t) -1),
-    m_fEnabled(fEnabled)
+    m_fEnabled(fEnabled),
+    m_fPriority(false),
+    m_uSpillId(0)
   {
     IN_LOCK_INIT
   }
@@ -477,6 +510,29 @@ public:
     return m_fEnabled;
   }
   
+  /// Sets the watch priority.
+  /**
+   * Events of high priority watches are queued separately
+   * and returned before all other events.
+   * 
+   * \param[in] fPriority high priority yes/no
+   * 
+   * \sa Inotify::GetPriorityEvent()
+   */
+  inline void SetPriority(bool fPriority)
+  {
+    m_fPriority = fPriority;
+  }
+  
+  /// Checks whether the watch has high priority.
+  /**
+   * \return true = high priority, false = normal priority
+   */
+  inline bool IsPriority() const
+  {
+    return m_fPriority;
+  }
+  
   /// Checks whether the watch is recursive.
   /**
    * A recursive watch monitors a directory itself and all
@@ -500,6 +556,8 @@ private:
   int32_t m_wd;         ///< watch descriptor
   Inotify* m_pInotify;  ///< inotify object
   bool m_fEnabled;      ///< events enabled yes/no
+  bool m_fPriority;     ///< high priority yes/no
+  uint32_t m_uSpillId;  ///< identifier in the spill file (0 = none)
   
   IN_LOCK_DECL
   
@@ -519,6 +577,9 @@ typedef std::map<int32_t, InotifyWatch*> IN_WATCH_MAP;
 /// Mapping from paths to watch objects.
 typedef std::map<std::string, InotifyWatch*> IN_WP_MAP;
 
+/// Mapping from spill file identifiers to watch objects.
+typedef std::map<uint32_t, InotifyWatch*> IN_SPILL_MAP;
+
 
 /// inotify class
 /**
@@ -570,6 +631,7 @@ public:
   /// Removes a watch.
   /**
    * If the given watch is not present it does nothing.
+   * Queued events of the watch are discarded.
    * 
    * \param[in] pWatch inotify watch
    * 
@@ -630,40 +692,129 @@ public:
    * in nonblocking mode it only retrieves occurred events
    * to the internal queue and exits.
    * 
+   * If the first read fills the buffer the kernel queue is
+   * drained by further reads (sized by the amount of pending
+   * data) until it is empty or a batch limit is reached.
+   * The buffer grown this way shrinks back step by step while
+   * only little data arrives.
+   * 
    * \param[in] fNoIntr if true it re-calls the system call after a handled signal
    * 
    * \throw InotifyException thrown if reading events failed
    * 
-   * \sa SetNonBlock()
+   * \sa SetNonBlock(), SetBatchLimits()
    */
   void WaitForEvents(bool fNoIntr = false) throw (InotifyException);
   
+  /// Sets limits for draining the kernel queue.
+  /**
+   * WaitForEvents() stops reading when one of the limits is
+   * exceeded even if more events are pending. This bounds the
+   * time spent on one inotify object while others wait.
+   * 
+   * \param[in] uBytes maximum bytes read per call (0 = unlimited)
+   * \param[in] uUsec maximum time spent per call in microseconds (0 = unlimited)
+   */
+  inline void SetBatchLimits(size_t uBytes, unsigned uUsec)
+  {
+    IN_WRITE_BEGIN
+    m_uBatchBytes = uBytes;
+    m_uBatchUsec = uUsec;
+    IN_WRITE_END
+  }
+  
   /// Returns the count of received and queued events.
   /**
    * This number is related to the events in the queue inside
    * this object, not to the events pending in the kernel.
+   * Events spilled to disk are included.
    * 
    * \return count of events
    */
   inline size_t GetEventCount()
   {
     IN_READ_BEGIN
-    size_t n = (size_t) m_events.size();
+    size_t n = (size_t) m_events.size() + m_fastEvents.size() + m_uSpillCount;
     IN_READ_END
     return n;
   }
   
+  /// Returns the count of events spilled to disk.
+  /**
+   * \return count of spilled events
+   * 
+   * \sa SetBacklogLimit()
+   */
+  inline size_t GetSpilledCount()
+  {
+    IN_READ_BEGIN
+    size_t n = m_uSpillCount;
+    IN_READ_END
+    return n;
+  }
+  
+  /// Returns the count of lost events.
+  /**
+   * \return count of events lost by spilling
+   * 
+   * \sa SetBacklogLimit()
+   */
+  inline size_t GetLostCount() const
+  {
+    return m_uLostCount;
+  }
+  
+  /// Limits the in-memory event queue.
+  /**
+   * Events received beyond the limit are appended to an
+   * anonymous spill file created in the given directory. They
+   * are moved back to the memory queue (in the original order)
+   * as the queue drains. If the spill file cannot be written
+   * the events are kept in memory - unless earlier events are
+   * still spilled; such events are lost to keep the order.
+   * Unreadable spilled events are lost too.
+   * 
+   * \param[in] uLimit maximum count of events kept in memory (0 = unlimited)
+   * \param[in] rSpillDir directory for the spill file
+   * 
+   * \sa GetSpilledCount(), GetLostCount()
+   */
+  void SetBacklogLimit(size_t uLimit, const std::string& rSpillDir);
+  
+  /// Returns the in-memory event queue limit.
+  /**
+   * \return maximum count of events kept in memory (0 = unlimited)
+   */
+  inline size_t GetBacklogLimit() const
+  {
+    return m_uBacklogLimit;
+  }
+  
   /// Extracts a queued inotify event.
   /**
    * The extracted event is removed from the queue.
    * If the pointer is NULL it does nothing.
    * 
+   * Events of high priority watches are returned first.
+   * 
    * \param[in,out] pEvt event object
    * 
    * \throw InotifyException thrown if the provided pointer is NULL
    */
   bool GetEvent(InotifyEvent* pEvt) throw (InotifyException);
   
+  /// Extracts a queued event of a high priority watch.
+  /**
+   * The extracted event is removed from the queue. Events
+   * of other watches stay queued.
+   * 
+   * \param[in,out] rEvt event object
+   * \return true = event extracted, false = no such event queued
+   * 
+   * \sa InotifyWatch::SetPriority()
+   */
+  bool GetPriorityEvent(InotifyEvent& rEvt);
+  
   /// Extracts a queued inotify event.
   /**
    * The extracted event is removed from the queue.
@@ -870,14 +1021,71 @@ private:
   int m_fd;                             ///< file descriptor
   IN_WATCH_MAP m_watches;               ///< watches (by descriptors)
   IN_WP_MAP m_paths;                    ///< watches (by paths)
-  unsigned char m_buf[INOTIFY_BUFLEN];  ///< buffer for events
+  std::vector<unsigned char> m_buf;     ///< buffer for events
+  size_t m_uBatchBytes;                 ///< maximum bytes read per call (0 = unlimited)
+  unsigned m_uBatchUsec;                ///< maximum time per call (0 = unlimited)
+  unsigned m_uSmallReads;               ///< count of successive calls reading a quarter of the buffer at most
   std::deque<InotifyEvent> m_events;    ///< event queue
+  std::deque<InotifyEvent> m_fastEvents;  ///< high priority event queue
+  size_t m_uBacklogLimit;               ///< in-memory event queue limit (0 = unlimited)
+  std::string m_spillDir;               ///< spill file directory
+  int m_spillFd;                        ///< spill file descriptor (-1 = not open)
+  off_t m_spillRd;                      ///< spill file read offset
+  off_t m_spillWr;                      ///< spill file write offset
+  size_t m_uSpillCount;                 ///< count of spilled events
+  size_t m_uLostCount;                  ///< count of events lost by spilling
+  IN_SPILL_MAP m_spillWatches;          ///< watches of spilled events (by identifiers)
+  uint32_t m_uSpillSerial;              ///< last assigned spill identifier
   
   IN_LOCK_DECL
   
   friend class InotifyWatch;
   
   static std::string GetCapabilityPath(InotifyCapability_t cap) throw (InotifyException);
+  
+  /// Appends an event to the queue (or the spill file).
+  /**
+   * Events of high priority watches are never spilled.
+   * 
+   * \param[in] rEvt event
+   * 
+   * \attention Must be called with the write lock held.
+   */
+  void PushEvent(const InotifyEvent& rEvt);
+  
+  /// Appends an event to the spill file.
+  /**
+   * \param[in] rEvt event
+   * \return true = event spilled, false = spilling failed
+   */
+  bool SpillEvent(const InotifyEvent& rEvt);
+  
+  /// Moves spilled events back to the memory queue.
+  /**
+   * It stops when the queue is full or the spill file
+   * is exhausted.
+   * 
+   * \attention Must be called with the write lock held.
+   */
+  void Unspill();
+  
+  /// Removes queued events of a watch.
+  /**
+   * Spilled events are not removed from the file. The watch
+   * is only forgotten by it, so the events are dropped when
+   * read back.
+   * 
+   * \param[in] pWatch inotify watch
+   * 
+   * \attention Must be called with the write lock held.
+   */
+  void DropEvents(InotifyWatch* pWatch);
+  
+  /// Forgets the watches of spilled events.
+  /**
+   * \attention Must be called with the write lock held.
+   */
+  void ForgetSpilled();
 };
 
 
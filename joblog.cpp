@@ -0,0 +1,213 @@
+
+/// inotify cron daemon job output logging implementation
+/**
+ * \file joblog.cpp
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+
+#include <pwd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <cstring>
+
+#include "joblog.h"
+#include "incroncfg.h"
+#include "usertable.h"
+
+/// Maximum count of bytes read from a pipe at once
+#define OUTPUT_READ_MAX 65536
+
+/// Maximum length of a logged line (longer ones are split)
+#define OUTPUT_LINE_MAX 4096
+
+
+JobLog* JobLog::Create(const std::string& rName)
+{
+  std::string dir;
+  if (!IncronCfg::GetValue("job_log_dir", dir) || dir.empty())
+    return NULL;
+
+  unsigned size = 0, rotate = 0;
+  IncronCfg::GetValue("job_log_size", size);
+  IncronCfg::GetValue("job_log_rotate", rotate);
+
+  return new JobLog(IncronCfg::BuildPath(dir, rName + ".log"), size, rotate);
+}
+
+JobLog::JobLog(const std::string& rPath, size_t maxSize, unsigned uRotate)
+: m_path(rPath),
+  m_fd(-1),
+  m_size(0),
+  m_maxSize(maxSize),
+  m_uRotate(uRotate),
+  m_uRefs(1)
+{
+
+}
+
+JobLog::~JobLog()
+{
+  if (m_fd != -1)
+    close(m_fd);
+}
+
+void JobLog::Release()
+{
+  if (--m_uRefs == 0)
+    delete this;
+}
+
+void JobLog::Write(unsigned jobId, pid_t pid, const char* pData, size_t len)
+{
+  char hdr[80];
+  time_t t = time(NULL);
+  struct tm tm;
+  localtime_r(&t, &tm);
+  size_t hl = strftime(hdr, sizeof(hdr), "%Y-%m-%d %H:%M:%S", &tm);
+  hl += snprintf(hdr + hl, sizeof(hdr) - hl, " [job %u pid %i] ", jobId, (int) pid);
+
+  if (m_maxSize > 0 && m_size + hl + len + 1 > m_maxSize && m_size > 0)
+    Rotate();
+
+  if (m_fd == -1) {
+    Open();
+    if (m_fd == -1)
+      return;
+  }
+
+  struct iovec iov[3];
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = hl;
+  iov[1].iov_base = (void*) pData;
+  iov[1].iov_len = len;
+  iov[2].iov_base = (void*) "\n";
+  iov[2].iov_len = 1;
+
+  ssize_t n = writev(m_fd, iov, 3);
+  if (n > 0)
+    m_size += n;
+}
+
+void JobLog::Open()
+{
+  m_fd = open(m_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+  if (m_fd == -1) {
+    syslog(LOG_ERR, "cannot open job log %s: (%i) %s", m_path.c_str(), errno, strerror(errno));
+    return;
+  }
+
+  struct stat st;
+  m_size = fstat(m_fd, &st) == 0 ? st.st_size : 0;
+}
+
+void JobLog::Rotate()
+{
+  if (m_fd != -1) {
+    close(m_fd);
+    m_fd = -1;
+  }
+
+  // the oldest file is overwritten
+  for (unsigned i=m_uRotate; i>0; i--) {
+    char s[16];
+    snprintf(s, sizeof(s), ".%u", i);
+    std::string to = m_path + s;
+    std::string from = m_path;
+    if (i > 1) {
+      snprintf(s, sizeof(s), ".%u", i - 1);
+      from.append(s);
+    }
+    rename(from.c_str(), to.c_str());
+  }
+
+  if (m_uRotate == 0)
+    unlink(m_path.c_str());
+
+  m_size = 0;
+}
+
+
+void OutputCapture::Start(EventDispatcher* pEd, int iFd, JobLog* pLog, unsigned jobId, pid_t pid)
+{
+  fcntl(iFd, F_SETFL, fcntl(iFd, F_GETFL) | O_NONBLOCK);
+  new OutputCapture(pEd, iFd, pLog, jobId, pid);
+}
+
+OutputCapture::OutputCapture(EventDispatcher* pEd, int iFd, JobLog* pLog, unsigned jobId, pid_t pid)
+: m_pEd(pEd),
+  m_fd(iFd),
+  m_pLog(pLog),
+  m_jobId(jobId),
+  m_pid(pid)
+{
+  m_pLog->AddRef();
+  m_pEd->RegisterFd(m_fd, POLLIN, OnReady, this);
+}
+
+OutputCapture::~OutputCapture()
+{
+  if (!m_line.empty())
+    m_pLog->Write(m_jobId, m_pid, m_line.data(), m_line.length());
+
+  m_pEd->UnregisterFd(m_fd);
+  close(m_fd);
+  m_pLog->Release();
+}
+
+void OutputCapture::OnReady(int iFd, short, void* pArg)
+{
+  OutputCapture* pOc = (OutputCapture*) pArg;
+
+  char buf[OUTPUT_READ_MAX];
+  ssize_t n = read(iFd, buf, sizeof(buf));
+  if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    return;
+
+  // the job (and all its children) closed the output
+  if (n <= 0) {
+    delete pOc;
+    return;
+  }
+
+  // complete lines are written directly from the buffer
+  const char* p = buf;
+  const char* end = buf + n;
+  while (p < end) {
+    const char* nl = (const char*) memchr(p, '\n', end - p);
+    if (nl == NULL) {
+      pOc->m_line.append(p, end - p);
+      break;
+    }
+
+    if (pOc->m_line.empty()) {
+      pOc->m_pLog->Write(pOc->m_jobId, pOc->m_pid, p, nl - p);
+    }
+    else {
+      pOc->m_line.append(p, nl - p);
+      pOc->m_pLog->Write(pOc->m_jobId, pOc->m_pid, pOc->m_line.data(), pOc->m_line.length());
+      pOc->m_line.clear();
+    }
+    p = nl + 1;
+  }
+
+  if (pOc->m_line.length() >= OUTPUT_LINE_MAX) {
+    pOc->m_pLog->Write(pOc->m_jobId, pOc->m_pid, pOc->m_line.data(), pOc->m_line.length());
+    pOc->m_line.clear();
+  }
+}
@@ -0,0 +1,136 @@
+
+/// inotify cron daemon job output logging header
+/**
+ * \file joblog.h
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+#ifndef _JOBLOG_H_
+#define _JOBLOG_H_
+
+#include <string>
+#include <sys/types.h>
+
+
+class EventDispatcher;
+
+
+/// Job output log class.
+/**
+ * It is a size-capped log file of a table. When the size limit
+ * would be exceeded the file is rotated (log -> log.1 -> log.2 ...)
+ * and the oldest one is removed. Thus the disk usage is bounded
+ * by the size limit multiplied by the count of kept files.
+ *
+ * Logs are reference counted because job output may come
+ * after the table is gone.
+ */
+class JobLog
+{
+public:
+  /// Creates a log for a table.
+  /**
+   * \param[in] rName table log name
+   * \return log; NULL if logging is disabled
+   */
+  static JobLog* Create(const std::string& rName);
+
+  /// Adds a reference.
+  inline void AddRef()
+  {
+    m_uRefs++;
+  }
+
+  /// Releases a reference (the log is destroyed with the last one).
+  void Release();
+
+  /// Writes a record.
+  /**
+   * \param[in] jobId job ID
+   * \param[in] pid process ID
+   * \param[in] pData record text (without the line end)
+   * \param[in] len text length
+   */
+  void Write(unsigned jobId, pid_t pid, const char* pData, size_t len);
+
+private:
+  std::string m_path;   ///< file path
+  int m_fd;             ///< file descriptor (-1 = not open)
+  size_t m_size;        ///< current file size
+  size_t m_maxSize;     ///< maximum file size
+  unsigned m_uRotate;   ///< count of rotated files kept
+  unsigned m_uRefs;     ///< reference count
+
+  /// Constructor.
+  /**
+   * \param[in] rPath file path
+   * \param[in] maxSize maximum file size
+   * \param[in] uRotate count of rotated files kept
+   */
+  JobLog(const std::string& rPath, size_t maxSize, unsigned uRotate);
+
+  /// Destructor.
+  ~JobLog();
+
+  /// Opens the file.
+  void Open();
+
+  /// Rotates the files.
+  void Rotate();
+};
+
+
+/// Job output capture class.
+/**
+ * It reads output of a job from a non-blocking pipe (polled
+ * by the event dispatcher) and writes it line by line to a job
+ * log. At most OUTPUT_READ_MAX bytes are read at once so that
+ * a chatty job cannot monopolize the daemon. The capture
+ * destroys itself at the end of the output.
+ */
+class OutputCapture
+{
+public:
+  /// Starts capturing.
+  /**
+   * \param[in] pEd event dispatcher
+   * \param[in] iFd pipe read end (taken over)
+   * \param[in] pLog job log
+   * \param[in] jobId job ID
+   * \param[in] pid job process ID
+   */
+  static void Start(EventDispatcher* pEd, int iFd, JobLog* pLog, unsigned jobId, pid_t pid);
+
+private:
+  EventDispatcher* m_pEd; ///< event dispatcher
+  int m_fd;               ///< pipe read end
+  JobLog* m_pLog;         ///< job log
+  unsigned m_jobId;       ///< job ID
+  pid_t m_pid;            ///< job process ID
+  std::string m_line;     ///< incomplete line
+
+  /// Constructor.
+  OutputCapture(EventDispatcher* pEd, int iFd, JobLog* pLog, unsigned jobId, pid_t pid);
+
+  /// Destructor.
+  ~OutputCapture();
+
+  /// Processes the pipe readiness.
+  /**
+   * \param[in] iFd descriptor
+   * \param[in] revents returned events
+   * \param[in] pArg capture
+   */
+  static void OnReady(int iFd, short revents, void* pArg);
+};
+
+
+#endif //_JOBLOG_H_
@@ -0,0 +1,196 @@
+
+/// inotify cron daemon job spawning implementation
+/**
+ * \file jobspawn.cpp
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <grp.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <cstring>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#endif // __linux__
+
+#include "jobspawn.h"
+
+/// Child stack size
+#define SPAWN_STACK_SIZE (64 * 1024)
+
+
+extern char** environ;
+
+
+/// Spawning context shared with the child
+typedef struct
+{
+  const SpawnParams_t* pParams; ///< spawning parameters
+  sigset_t mask;                ///< signal mask to restore
+  int err;                      ///< error number (set by the child)
+} SpawnCtx_t;
+
+
+/// Prepares the child process and executes the program.
+/**
+ * It runs in the child. On Linux it shares the memory with
+ * the daemon, so it must not allocate memory or take locks.
+ * Credentials are switched by direct system calls (libc
+ * wrappers may synchronize with other threads).
+ *
+ * \param[in] pArg spawning context
+ * \return never returns on success
+ */
+static int spawn_child(void* pArg)
+{
+  SpawnCtx_t* pCtx = (SpawnCtx_t*) pArg;
+  const SpawnParams_t* pP = pCtx->pParams;
+
+  // handlers of the daemon must not run here
+  for (int sig = 1; sig < NSIG; sig++) {
+    struct sigaction sa;
+    if (sigaction(sig, NULL, &sa) == 0 && sa.sa_handler != SIG_DFL && sa.sa_handler != SIG_IGN) {
+      sa.sa_handler = SIG_DFL;
+      sa.sa_flags = 0;
+      sigaction(sig, &sa, NULL);
+    }
+  }
+  sigprocmask(SIG_SETMASK, &pCtx->mask, NULL);
+
+  for (int i=0; i<3; i++) {
+    if (pP->fds[i] == -1)
+      continue;
+
+    if (pP->fds[i] == i) {
+      if (fcntl(i, F_SETFD, 0) != 0)
+        goto failed;
+    }
+    else if (dup2(pP->fds[i], i) == -1) {
+      goto failed;
+    }
+  }
+
+  // the job leads its own process group (to be killed as a whole)
+  if (setpgid(0, 0) != 0)
+    goto failed;
+
+  // the cgroup is joined before switching credentials
+  if (pP->cgroupFd != -1 && write(pP->cgroupFd, "0", 1) != 1)
+    goto failed;
+
+  if (pP->fSetCreds) {
+    if (    syscall(SYS_setgroups, pP->ngroups, pP->groups) != 0
+        ||  syscall(SYS_setresgid, pP->gid, pP->gid, pP->gid) != 0
+        ||  syscall(SYS_setresuid, pP->uid, pP->uid, pP->uid) != 0)
+    {
+      goto failed;
+    }
+  }
+
+  // scheduling is changed with the job's credentials (no privileges are gained)
+  if (pP->pSched != NULL) {
+    const JobSched_t* pS = pP->pSched;
+    if (pS->fNice && setpriority(PRIO_PROCESS, 0, pS->nice) != 0)
+      goto failed;
+#ifdef SYS_ioprio_set
+    if (pS->ioprio != -1 && syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, pS->ioprio) != 0)
+      goto failed;
+#endif // SYS_ioprio_set
+    if (pS->policy != -1) {
+      struct sched_param param;
+      param.sched_priority = 0;
+      if (sched_setscheduler(0, pS->policy, &param) != 0)
+        goto failed;
+    }
+    if (pS->fCpus && sched_setaffinity(0, sizeof(pS->cpus), &pS->cpus) != 0)
+      goto failed;
+  }
+
+  execve(pP->path, pP->argv, pP->envp != NULL ? pP->envp : environ);
+
+failed:
+
+  pCtx->err = errno;
+  _exit(127);
+}
+
+
+void JobSpawner::Init(SpawnParams_t& rParams)
+{
+  memset(&rParams, 0, sizeof(rParams));
+  for (int i=0; i<3; i++) {
+    rParams.fds[i] = -1;
+  }
+  rParams.cgroupFd = -1;
+}
+
+void JobSpawner::InitSched(JobSched_t& rSched)
+{
+  memset(&rSched, 0, sizeof(rSched));
+  rSched.ioprio = -1;
+  rSched.policy = -1;
+}
+
+pid_t JobSpawner::Spawn(const SpawnParams_t& rParams)
+{
+  SpawnCtx_t ctx;
+  ctx.pParams = &rParams;
+  ctx.err = 0;
+
+  sigset_t all;
+  sigfillset(&all);
+  sigprocmask(SIG_BLOCK, &all, &ctx.mask);
+
+#ifdef __linux__
+  static void* s_pStack = NULL;
+  if (s_pStack == NULL) {
+    void* p = mmap(NULL, SPAWN_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (p == MAP_FAILED) {
+      int err = errno;
+      sigprocmask(SIG_SETMASK, &ctx.mask, NULL);
+      errno = err;
+      return -1;
+    }
+    s_pStack = p;
+  }
+
+  // the daemon is suspended until the child executes (or exits)
+  pid_t pid = clone(spawn_child, (char*) s_pStack + SPAWN_STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD, &ctx);
+  int err = errno;
+#else // __linux__
+  pid_t pid = fork();
+  if (pid == 0)
+    spawn_child(&ctx);
+  int err = errno;
+#endif // __linux__
+
+  sigprocmask(SIG_SETMASK, &ctx.mask, NULL);
+
+  if (pid == -1) {
+    errno = err;
+    return -1;
+  }
+
+  // executing failed - the child has already finished
+  if (ctx.err != 0) {
+    errno = ctx.err;
+    return -1;
+  }
+
+  return pid;
+}
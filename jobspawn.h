@@ -0,0 +1,90 @@
+
+/// inotify cron daemon job spawning header
+/**
+ * \file jobspawn.h
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+#ifndef _JOBSPAWN_H_
+#define _JOBSPAWN_H_
+
+#include <sched.h>
+#include <sys/types.h>
+
+
+/// Job scheduling attributes
+typedef struct
+{
+  bool fNice;           ///< change the nice value yes/no
+  int nice;             ///< nice value (-20 to 19)
+  int ioprio;           ///< I/O priority as for ioprio_set() (-1 = unchanged)
+  int policy;           ///< scheduling policy, e.g. SCHED_IDLE (-1 = unchanged)
+  bool fCpus;           ///< restrict CPU affinity yes/no
+  cpu_set_t cpus;       ///< allowed CPUs
+} JobSched_t;
+
+/// Job spawning parameters
+typedef struct
+{
+  const char* path;     ///< executable path
+  char* const* argv;    ///< argument vector (NULL terminated)
+  char* const* envp;    ///< environment (NULL terminated; NULL = inherited)
+  bool fSetCreds;       ///< switch credentials yes/no
+  uid_t uid;            ///< user ID
+  gid_t gid;            ///< primary group ID
+  const gid_t* groups;  ///< supplementary groups
+  size_t ngroups;       ///< count of supplementary groups
+  int fds[3];           ///< standard input, output and error (-1 = inherited)
+  int cgroupFd;         ///< cgroup.procs descriptor of the target cgroup (-1 = none)
+  const JobSched_t* pSched; ///< scheduling attributes (NULL = inherited)
+} SpawnParams_t;
+
+
+/// Job spawner class.
+/**
+ * It starts jobs without copying the daemon's address space.
+ * On Linux the child shares the memory with the daemon
+ * (CLONE_VM) and the daemon is suspended until the child
+ * executes the program (CLONE_VFORK). Thus the cost doesn't
+ * grow with the daemon size. Each job leads its own process
+ * group. The child only makes system calls
+ * (no memory allocation, no locking) before executing.
+ * On other systems it falls back to fork().
+ */
+class JobSpawner
+{
+public:
+  /// Starts a job.
+  /**
+   * \param[in] rParams spawning parameters
+   * \return process ID; -1 on error (errno is set)
+   */
+  static pid_t Spawn(const SpawnParams_t& rParams);
+
+  /// Initializes spawning parameters.
+  /**
+   * Nothing is changed in the child by default.
+   * 
+   * \param[out] rParams spawning parameters
+   */
+  static void Init(SpawnParams_t& rParams);
+
+  /// Initializes scheduling attributes.
+  /**
+   * Nothing is changed by default.
+   *
+   * \param[out] rSched scheduling attributes
+   */
+  static void InitSched(JobSched_t& rSched);
+};
+
+
+#endif //_JOBSPAWN_H_
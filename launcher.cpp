@@ -0,0 +1,741 @@
+
+/// inotify cron daemon user launcher implementation
+/**
+ * \file launcher.cpp
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+
+#include <pwd.h>
+#include <grp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/poll.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <cstring>
+#include <vector>
+
+#include "launcher.h"
+#include "usertable.h"
+#include "jobspawn.h"
+
+/// Socket descriptor in the launcher process
+#define LAUNCHER_FD 3
+
+
+LAUNCHER_MAP Launcher::s_map;
+PROCSTARTED_LIST Launcher::s_started;
+PROCDONE_LIST Launcher::s_done;
+
+extern int g_cldPipe[2];
+
+/// Ancillary data buffer (for passing descriptors)
+typedef union
+{
+  struct cmsghdr hdr;                       ///< header (for alignment)
+  char buf[CMSG_SPACE(LAUNCH_FDS * sizeof(int))];   ///< data
+} LaunchCtl_t;
+
+/// SIGCHLD notification pipe (in the launcher process)
+static int s_sigPipe[2];
+
+
+/// Returns the monotonic time.
+/**
+ * \return time in milliseconds
+ */
+static uint64_t now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+/// Returns the parent of a process.
+/**
+ * \param[in] pid process ID
+ * \return parent process ID; -1 if the process is gone
+ */
+static pid_t get_ppid(pid_t pid)
+{
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%i/stat", (int) pid);
+  FILE* f = fopen(path, "r");
+  if (f == NULL)
+    return -1;
+
+  char s[512];
+  size_t n = fread(s, 1, sizeof(s) - 1, f);
+  fclose(f);
+  s[n] = '\0';
+
+  // the command name may contain anything (incl. parentheses)
+  int ppid = -1;
+  char* p = strrchr(s, ')');
+  if (p == NULL || sscanf(p + 1, " %*c %i", &ppid) != 1)
+    return -1;
+  return (pid_t) ppid;
+}
+
+/// Returns the process a process descriptor refers to.
+/**
+ * \param[in] iPidFd process descriptor
+ * \return process ID; 0 = unknown, -1 = process gone
+ */
+static pid_t get_pidfd_pid(int iPidFd)
+{
+  char path[48];
+  snprintf(path, sizeof(path), "/proc/self/fdinfo/%i", iPidFd);
+  FILE* f = fopen(path, "r");
+  if (f == NULL)
+    return -1;
+
+  int pid = 0;
+  char s[128];
+  while (fgets(s, sizeof(s), f) != NULL) {
+    if (sscanf(s, "Pid: %i", &pid) == 1)
+      break;
+  }
+  fclose(f);
+  return (pid_t) pid;
+}
+
+
+/// Handles SIGCHLD in the launcher process.
+/**
+ * \param[in] signo signal number
+ */
+static void on_launcher_signal(int)
+{
+  int err = errno;
+  if (write(s_sigPipe[1], "X", 1) <= 0) {}
+  errno = err;
+}
+
+/// Sends a reply to the daemon.
+/**
+ * \param[in] type message type
+ * \param[in] id job ID
+ * \param[in] pid process ID
+ * \param[in] value error number or wait status
+ * \param[in] pUsage resource usage (NULL = none)
+ * \param[in] iPidFd process descriptor to pass (-1 = none)
+ */
+static void send_reply(uint32_t type, int32_t id, pid_t pid, int value, const struct rusage* pUsage, int iPidFd)
+{
+  LaunchReply_t rep;
+  memset(&rep, 0, sizeof(rep));
+  rep.type = type;
+  rep.id = id;
+  rep.pid = (int32_t) pid;
+  rep.value = (int32_t) value;
+  if (pUsage != NULL)
+    rep.usage = *pUsage;
+
+  struct iovec iov;
+  iov.iov_base = &rep;
+  iov.iov_len = sizeof(rep);
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  LaunchCtl_t cbuf;
+  if (iPidFd != -1) {
+    msg.msg_control = cbuf.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int));
+    struct cmsghdr* pCm = CMSG_FIRSTHDR(&msg);
+    pCm->cmsg_level = SOL_SOCKET;
+    pCm->cmsg_type = SCM_RIGHTS;
+    pCm->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(pCm), &iPidFd, sizeof(int));
+  }
+
+  // failures are ignored (the daemon may be gone)
+  while (sendmsg(LAUNCHER_FD, &msg, MSG_NOSIGNAL) == -1 && errno == EINTR) {}
+}
+
+
+Launcher::Launcher(EventDispatcher* pEd, const std::string& rUser)
+: m_fd(-1),
+  m_pid(-1),
+  m_user(rUser),
+  m_pEd(pEd),
+  m_timer(0),
+  m_fRetired(false)
+{
+
+}
+
+Launcher::~Launcher()
+{
+  if (m_fd != -1)
+    Close();
+}
+
+Launcher* Launcher::Get(EventDispatcher* pEd, const std::string& rUser)
+{
+  LAUNCHER_MAP::iterator it = s_map.find(rUser);
+  if (it != s_map.end()) {
+    if ((*it).second->IsAlive())
+      return (*it).second;
+
+    // the old launcher is gone, start a new one
+    delete (*it).second;
+    s_map.erase(it);
+  }
+
+  Launcher* pL = new Launcher(pEd, rUser);
+  if (!pL->Start()) {
+    syslog(LOG_ERR, "cannot start launcher for user %s: %s", rUser.c_str(), strerror(errno));
+    delete pL;
+    return NULL;
+  }
+
+  s_map.insert(LAUNCHER_MAP::value_type(rUser, pL));
+  return pL;
+}
+
+void Launcher::Retire(const std::string& rUser)
+{
+  LAUNCHER_MAP::iterator it = s_map.find(rUser);
+  if (it == s_map.end())
+    return;
+
+  Launcher* pL = (*it).second;
+  s_map.erase(it);
+
+  if (pL->IsAlive()) {
+    // the launcher finishes on EOF (after its jobs finish)
+    pL->m_fRetired = true;
+    shutdown(pL->m_fd, SHUT_WR);
+  }
+  else {
+    delete pL;
+  }
+}
+
+void Launcher::RetireAll()
+{
+  while (!s_map.empty()) {
+    Retire((*s_map.begin()).first);
+  }
+}
+
+bool Launcher::GetStarted(ProcStarted_t& rStarted)
+{
+  if (s_started.empty())
+    return false;
+
+  rStarted = s_started.front();
+  s_started.pop_front();
+  return true;
+}
+
+bool Launcher::GetDone(ProcDone_t& rDone)
+{
+  if (s_done.empty())
+    return false;
+
+  rDone = s_done.front();
+  s_done.pop_front();
+  return true;
+}
+
+bool Launcher::Spawn(pid_t id, char* const* argv, const int* fds, int iCgroupFd, const JobSched_t* pSched)
+{
+  if (m_fd == -1) {
+    errno = EPIPE;
+    return false;
+  }
+
+  LaunchReq_t req;
+  req.type = LAUNCH_MSG_START;
+  req.id = (int32_t) id;
+  req.argc = 0;
+  req.fdmask = 0;
+  if (pSched != NULL)
+    req.sched = *pSched;
+  else
+    JobSpawner::InitSched(req.sched);
+
+  std::vector<char> buf(sizeof(req));
+  for (; argv[req.argc] != NULL; req.argc++) {
+    const char* s = argv[req.argc];
+    buf.insert(buf.end(), s, s + strlen(s) + 1);
+  }
+
+  // descriptors go as ancillary data
+  struct iovec iov;
+  iov.iov_base = &buf[0];
+  iov.iov_len = buf.size();
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  LaunchCtl_t cbuf;
+  int cfds[LAUNCH_FDS];
+  int nfds = 0;
+  for (int i=0; i<LAUNCH_FDS; i++) {
+    int fd = i < 3 ? fds[i] : iCgroupFd;
+    if (fd != -1) {
+      req.fdmask |= 1 << i;
+      cfds[nfds++] = fd;
+    }
+  }
+
+  if (nfds > 0) {
+    msg.msg_control = cbuf.buf;
+    msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+    struct cmsghdr* pCm = CMSG_FIRSTHDR(&msg);
+    pCm->cmsg_level = SOL_SOCKET;
+    pCm->cmsg_type = SCM_RIGHTS;
+    pCm->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(pCm), cfds, nfds * sizeof(int));
+  }
+
+  memcpy(&buf[0], &req, sizeof(req));
+
+  // the socket doesn't block (a full one means a stuck launcher)
+  ssize_t n;
+  while ((n = sendmsg(m_fd, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR) {}
+  if (n == -1) {
+    int err = errno;
+    if (err != EAGAIN && err != EWOULDBLOCK)
+      Close();
+    errno = err;
+    return false;
+  }
+
+  // the result comes later (see OnReply())
+  m_jobs.insert(id);
+  m_sent.push_back(now_ms());
+  if (m_timer == 0)
+    m_timer = m_pEd->GetTimers()->Schedule(LAUNCHER_TIMEOUT, OnTimer, this);
+
+  return true;
+}
+
+bool Launcher::Start()
+{
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0)
+    return false;
+
+  // a fresh process (forking would copy the daemon's threads and locks)
+  const char* argv[] = { "/proc/self/exe", LAUNCHER_OPTION, m_user.c_str(), NULL };
+  SpawnParams_t sp;
+  JobSpawner::Init(sp);
+  sp.path = argv[0];
+  sp.argv = (char* const*) argv;
+  sp.fds[0] = sv[1];
+
+  pid_t pid = JobSpawner::Spawn(sp);
+  int err = errno;
+  close(sv[1]);
+  if (pid == -1) {
+    close(sv[0]);
+    errno = err;
+    return false;
+  }
+
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+  m_fd = sv[0];
+  m_pid = pid;
+  m_pEd->RegisterFd(m_fd, POLLIN, OnReady, this);
+
+  return true;
+}
+
+void Launcher::OnReply(const LaunchReply_t& rRep, int iPidFd)
+{
+  pid_t id = (pid_t) rRep.id;
+  if (m_jobs.find(id) == m_jobs.end()) {
+    if (iPidFd != -1)
+      close(iPidFd);
+    return;
+  }
+
+  if (rRep.type == LAUNCH_MSG_STARTED) {
+    // requests are answered in order
+    if (!m_sent.empty())
+      m_sent.pop_front();
+
+    ProcStarted_t ps;
+    ps.id = id;
+    ps.pid = (pid_t) rRep.pid;
+    ps.pidfd = iPidFd;
+    ps.error = (int) rRep.value;
+
+    // only the launcher's own children may be signalled later
+    if (ps.pid > 0) {
+      pid_t ppid = get_ppid(ps.pid);
+      pid_t fdPid = iPidFd != -1 ? get_pidfd_pid(iPidFd) : 0;
+      if (ppid != m_pid || (fdPid != 0 && fdPid != ps.pid)) {
+        // a job already finished (and reaped) needs no signals
+        if (ppid != -1 && fdPid != -1)
+          syslog(LOG_WARNING, "launcher for user %s reported foreign process %i", m_user.c_str(), (int) ps.pid);
+        if (iPidFd != -1)
+          close(iPidFd);
+        ps.pidfd = -1;
+        ps.pid = 0;
+      }
+    }
+    else if (iPidFd != -1) {
+      close(iPidFd);
+      ps.pidfd = -1;
+    }
+
+    s_started.push_back(ps);
+    if (ps.pid == -1)
+      m_jobs.erase(id);
+  }
+  else if (rRep.type == LAUNCH_MSG_DONE) {
+    if (iPidFd != -1)
+      close(iPidFd);
+
+    ProcDone_t pd;
+    pd.pid = id;
+    pd.status = (int) rRep.value;
+    pd.usage = rRep.usage;
+
+    m_jobs.erase(id);
+    s_done.push_back(pd);
+  }
+  else {
+    if (iPidFd != -1)
+      close(iPidFd);
+    return;
+  }
+
+  // let the main loop pick it up
+  if (write(g_cldPipe[1], "X", 1) <= 0) {
+    syslog(LOG_WARNING, "cannot send job token to notification pipe");
+  }
+}
+
+void Launcher::Close()
+{
+  m_pEd->UnregisterFd(m_fd);
+  close(m_fd);
+  m_fd = -1;
+
+  if (m_timer != 0) {
+    m_pEd->GetTimers()->Cancel(m_timer);
+    m_timer = 0;
+  }
+  m_sent.clear();
+
+  // the state of running jobs cannot be known anymore
+  std::set<pid_t>::iterator it = m_jobs.begin();
+  while (it != m_jobs.end()) {
+    LaunchReply_t rep;
+    memset(&rep, 0, sizeof(rep));
+    rep.type = LAUNCH_MSG_DONE;
+    rep.id = (int32_t) *it;
+    rep.value = -1;
+    it++;
+    OnReply(rep, -1);
+  }
+}
+
+void Launcher::OnReady(int iFd, short, void* pArg)
+{
+  Launcher* pL = (Launcher*) pArg;
+
+  LaunchReply_t rep;
+  ssize_t n;
+  for (;;) {
+    struct iovec iov;
+    iov.iov_base = &rep;
+    iov.iov_len = sizeof(rep);
+
+    LaunchCtl_t cbuf;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf.buf;
+    msg.msg_controllen = sizeof(cbuf.buf);
+
+    n = recvmsg(iFd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (n <= 0)
+      break;
+
+    // a process descriptor may come with a start reply
+    int fd = -1;
+    struct cmsghdr* pCm = CMSG_FIRSTHDR(&msg);
+    if (pCm != NULL && pCm->cmsg_level == SOL_SOCKET && pCm->cmsg_type == SCM_RIGHTS) {
+      int cfds[LAUNCH_FDS];
+      size_t nfds = (pCm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      memcpy(cfds, CMSG_DATA(pCm), nfds * sizeof(int));
+      for (size_t i=0; i<nfds; i++) {
+        if (i == 0)
+          fd = cfds[i];
+        else
+          close(cfds[i]);
+      }
+    }
+
+    if (n == (ssize_t) sizeof(rep))
+      pL->OnReply(rep, fd);
+    else if (fd != -1)
+      close(fd);
+  }
+
+  if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    if (!pL->m_fRetired)
+      syslog(LOG_WARNING, "launcher for user %s finished unexpectedly", pL->m_user.c_str());
+
+    pL->Close();
+
+    // retired launchers aren't referenced anymore
+    if (pL->m_fRetired)
+      delete pL;
+  }
+}
+
+void Launcher::OnTimer(void* pArg)
+{
+  Launcher* pL = (Launcher*) pArg;
+  pL->m_timer = 0;
+  if (pL->m_sent.empty())
+    return;
+
+  uint64_t waited = now_ms() - pL->m_sent.front();
+  if (waited < LAUNCHER_TIMEOUT) {
+    pL->m_timer = pL->m_pEd->GetTimers()->Schedule(LAUNCHER_TIMEOUT - waited, OnTimer, pL);
+    return;
+  }
+
+  // a new launcher is started for the next job
+  syslog(LOG_ERR, "launcher for user %s does not respond, killing it", pL->m_user.c_str());
+  kill(pL->m_pid, SIGKILL);
+  pL->Close();
+
+  if (pL->m_fRetired)
+    delete pL;
+}
+
+int Launcher::Run(const char* pszUser)
+{
+  // the socket comes as the standard input (jobs get /dev/null instead)
+  if (dup3(STDIN_FILENO, LAUNCHER_FD, O_CLOEXEC) == -1)
+    return 1;
+  int nullFd = open("/dev/null", O_RDONLY);
+  if (nullFd == -1 || dup2(nullFd, STDIN_FILENO) == -1)
+    return 1;
+  if (nullFd != STDIN_FILENO)
+    close(nullFd);
+
+#ifdef SYS_close_range
+  if (syscall(SYS_close_range, LAUNCHER_FD + 1, ~0U, 0) != 0)
+#endif // SYS_close_range
+  {
+    int max = (int) sysconf(_SC_OPEN_MAX);
+    for (int fd = LAUNCHER_FD + 1; fd < max; fd++) {
+      close(fd);
+    }
+  }
+
+  if (pipe2(s_sigPipe, O_CLOEXEC | O_NONBLOCK) != 0)
+    return 1;
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_launcher_signal;
+  sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGCHLD, &sa, NULL);
+
+  // switch to the user once for all jobs
+  struct passwd* pwd = getpwnam(pszUser);
+  if (    pwd == NULL                 // check query result
+      ||  setgid(pwd->pw_gid) != 0    // check GID
+      ||  initgroups(pszUser, pwd->pw_gid) != 0 // check supplementary groups
+      ||  setuid(pwd->pw_uid) != 0)   // check UID
+  {
+    return 1;
+  }
+
+  if (pwd->pw_uid != 0) {
+    if (    clearenv() != 0
+        ||  setenv("LOGNAME",   pwd->pw_name,   1) != 0
+        ||  setenv("USER",      pwd->pw_name,   1) != 0
+        ||  setenv("USERNAME",  pwd->pw_name,   1) != 0
+        ||  setenv("HOME",      pwd->pw_dir,    1) != 0
+        ||  setenv("SHELL",     pwd->pw_shell,  1) != 0
+        ||  setenv("PATH",      DEFAULT_PATH,   1) != 0)
+    {
+      return 1;
+    }
+  }
+
+  struct pollfd pfd[2];
+  pfd[0].fd = LAUNCHER_FD;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = s_sigPipe[0];
+  pfd[1].events = POLLIN;
+
+  bool fOpen = true;
+  std::map<pid_t, int32_t> jobs;
+  std::vector<char> buf;
+  std::vector<char*> argv;
+
+  while (fOpen || !jobs.empty()) {
+    pfd[0].fd = fOpen ? LAUNCHER_FD : -1;
+    pfd[0].revents = 0;
+    pfd[1].revents = 0;
+
+    if (poll(pfd, 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      return 1;
+    }
+
+    // report finished jobs
+    if (pfd[1].revents & POLLIN) {
+      char c;
+      while (read(s_sigPipe[0], &c, 1) > 0) {}
+
+      pid_t pid;
+      int status;
+      struct rusage ru;
+      while ((pid = wait4((pid_t) -1, &status, WNOHANG, &ru)) > 0) {
+        // unknown ones have failed to execute
+        std::map<pid_t, int32_t>::iterator it = jobs.find(pid);
+        if (it != jobs.end()) {
+          send_reply(LAUNCH_MSG_DONE, (*it).second, pid, status, &ru, -1);
+          jobs.erase(it);
+        }
+      }
+    }
+
+    if (pfd[0].revents == 0)
+      continue;
+
+    // get the request size first
+    ssize_t n = recv(LAUNCHER_FD, NULL, 0, MSG_PEEK | MSG_TRUNC);
+    
+    int fds[LAUNCH_FDS] = { -1, -1, -1, -1 };
+    if (n > 0) {
+      buf.resize(n);
+      
+      struct iovec iov;
+      iov.iov_base = &buf[0];
+      iov.iov_len = buf.size();
+      
+      LaunchCtl_t cbuf;
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = cbuf.buf;
+      msg.msg_controllen = sizeof(cbuf.buf);
+      
+      n = recvmsg(LAUNCHER_FD, &msg, MSG_CMSG_CLOEXEC);
+      
+      // received descriptors are assigned as marked in the request
+      struct cmsghdr* pCm = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+      if (pCm != NULL && pCm->cmsg_level == SOL_SOCKET && pCm->cmsg_type == SCM_RIGHTS) {
+        int cfds[LAUNCH_FDS];
+        size_t nfds = (pCm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(cfds, CMSG_DATA(pCm), nfds * sizeof(int));
+        
+        LaunchReq_t req;
+        memcpy(&req, &buf[0], sizeof(req));
+        size_t k = 0;
+        for (int i=0; i<LAUNCH_FDS && k<nfds; i++) {
+          if (req.fdmask & (1 << i))
+            fds[i] = cfds[k++];
+        }
+        while (k < nfds) {
+          close(cfds[k++]);
+        }
+      }
+    }
+
+    if (n == 0 || (n == -1 && errno != EINTR && errno != EAGAIN)) {
+      fOpen = false;
+      continue;
+    }
+
+    LaunchReq_t req;
+    if (n >= (ssize_t) sizeof(req))
+      memcpy(&req, &buf[0], sizeof(req));
+    
+    if (n < (ssize_t) sizeof(req) || req.type != LAUNCH_MSG_START) {
+      for (int i=0; i<LAUNCH_FDS; i++) {
+        if (fds[i] != -1)
+          close(fds[i]);
+      }
+      continue;
+    }
+
+    argv.clear();
+    size_t pos = sizeof(req);
+    for (uint32_t i=0; i<req.argc && pos < (size_t) n; i++) {
+      argv.push_back(&buf[pos]);
+      pos += strnlen(&buf[pos], n - pos) + 1;
+    }
+
+    pid_t pid = -1;
+    errno = EINVAL;
+    if (argv.size() == req.argc && !argv.empty() && pos <= (size_t) n) {
+      argv.push_back(NULL);
+
+      SpawnParams_t sp;
+      JobSpawner::Init(sp);
+      sp.path = argv[0];
+      sp.argv = &argv[0];
+      memcpy(sp.fds, fds, sizeof(sp.fds));
+      sp.cgroupFd = fds[3];
+      sp.pSched = &req.sched;
+
+      pid = JobSpawner::Spawn(sp);
+    }
+    
+    int err = errno;
+    for (int i=0; i<LAUNCH_FDS; i++) {
+      if (fds[i] != -1)
+        close(fds[i]);
+    }
+    
+    if (pid > 0) {
+      jobs.insert(std::map<pid_t, int32_t>::value_type(pid, req.id));
+
+      // the descriptor lets the daemon signal the job safely
+      int pidfd = -1;
+#ifdef SYS_pidfd_open
+      pidfd = (int) syscall(SYS_pidfd_open, pid, 0);
+#endif // SYS_pidfd_open
+      send_reply(LAUNCH_MSG_STARTED, req.id, pid, 0, NULL, pidfd);
+      if (pidfd != -1)
+        close(pidfd);
+    }
+    else {
+      send_reply(LAUNCH_MSG_STARTED, req.id, -1, err, NULL, -1);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,255 @@
+
+/// inotify cron daemon user launcher header
+/**
+ * \file launcher.h
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+#ifndef _LAUNCHER_H_
+#define _LAUNCHER_H_
+
+#include <map>
+#include <set>
+#include <deque>
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "jobspawn.h"
+#include "timerwheel.h"
+
+class EventDispatcher;
+class Launcher;
+
+/// Job start request (daemon to launcher)
+#define LAUNCH_MSG_START    1
+
+/// Job started (launcher to daemon)
+#define LAUNCH_MSG_STARTED  2
+
+/// Job finished (launcher to daemon)
+#define LAUNCH_MSG_DONE     3
+
+/// Count of descriptors which may be passed with a request
+#define LAUNCH_FDS 4
+
+/// Option starting the launcher mode
+#define LAUNCHER_OPTION "--launcher"
+
+/// Time (in milliseconds) a launcher may take to start a job
+#define LAUNCHER_TIMEOUT 10000
+
+/// Launcher request header (followed by NUL terminated arguments)
+/**
+ * Descriptors for the job's standard input, output and error
+ * and for joining a cgroup (as marked in the mask) are passed along.
+ */
+typedef struct
+{
+  uint32_t type;    ///< message type
+  int32_t id;       ///< job ID (pseudo process ID, echoed in replies)
+  uint32_t argc;    ///< count of arguments
+  uint32_t fdmask;  ///< passed descriptors (bit 0 = stdin, 1 = stdout, 2 = stderr, 3 = cgroup.procs)
+  JobSched_t sched; ///< scheduling attributes
+} LaunchReq_t;
+
+/// Launcher reply
+/**
+ * A started job's process descriptor is passed along if available.
+ */
+typedef struct
+{
+  uint32_t type;        ///< message type
+  int32_t id;           ///< job ID
+  int32_t pid;          ///< process ID (-1 = not started)
+  int32_t value;        ///< error number (started) or wait status (done)
+  struct rusage usage;  ///< resource usage (done)
+} LaunchReply_t;
+
+/// Started job data
+typedef struct
+{
+  pid_t id;             ///< job ID
+  pid_t pid;            ///< process ID (0 = unknown, -1 = not started)
+  int pidfd;            ///< process descriptor (-1 = none)
+  int error;            ///< error number (if not started)
+} ProcStarted_t;
+
+/// Finished job data
+typedef struct
+{
+  pid_t pid;            ///< job ID (as passed to Launcher::Spawn())
+  int status;           ///< wait status (-1 = unknown)
+  struct rusage usage;  ///< resource usage
+} ProcDone_t;
+
+/// User name to launcher mapping
+typedef std::map<std::string, Launcher*> LAUNCHER_MAP;
+
+/// Started job list
+typedef std::deque<ProcStarted_t> PROCSTARTED_LIST;
+
+/// Finished job list
+typedef std::deque<ProcDone_t> PROCDONE_LIST;
+
+
+/// User launcher class.
+/**
+ * A launcher is a long-lived process which runs with the credentials
+ * and the environment of an user. It is the daemon's executable started
+ * in the launcher mode (a fresh process, not a fork of the daemon). It receives job requests from
+ * the daemon over a socket and starts the jobs itself. Thus the user
+ * database is queried and the credentials are switched only once
+ * per user (instead of once per job).
+ *
+ * Requests are not waited for. Started and finished jobs are
+ * reported back and collected for the daemon which picks them
+ * by GetStarted() and GetDone(). It is notified through the same
+ * pipe as SIGCHLD. A launcher which doesn't report a start within
+ * LAUNCHER_TIMEOUT is killed and its jobs are considered finished.
+ */
+class Launcher
+{
+public:
+  /// Returns the launcher for an user.
+  /**
+   * The launcher is started if it doesn't run yet.
+   *
+   * \param[in] pEd event dispatcher
+   * \param[in] rUser user name
+   * \return launcher; NULL if it cannot be started
+   */
+  static Launcher* Get(EventDispatcher* pEd, const std::string& rUser);
+
+  /// Retires the launcher of an user.
+  /**
+   * The launcher accepts no more jobs and finishes as soon as
+   * its running jobs finish.
+   *
+   * \param[in] rUser user name
+   */
+  static void Retire(const std::string& rUser);
+
+  /// Retires all launchers.
+  static void RetireAll();
+
+  /// Fetches a finished job.
+  /**
+   * \param[out] rDone finished job data
+   * \return true = job fetched, false = no finished job
+   */
+  static bool GetDone(ProcDone_t& rDone);
+
+  /// Fetches a started job.
+  /**
+   * The reported process ID has been checked to be
+   * the launcher's child.
+   *
+   * \param[out] rStarted started job data
+   * \return true = job fetched, false = no started job
+   */
+  static bool GetStarted(ProcStarted_t& rStarted);
+
+  /// Requests a job start.
+  /**
+   * The job is reported by GetStarted() and GetDone()
+   * under the given ID.
+   *
+   * \param[in] id job ID (a pseudo process ID)
+   * \param[in] argv argument vector (the first one is the executable path)
+   * \param[in] fds standard input, output and error (-1 = inherited)
+   * \param[in] iCgroupFd cgroup.procs descriptor of the job's cgroup (-1 = none)
+   * \param[in] pSched scheduling attributes (NULL = inherited)
+   * \return true = request sent, false = failure (errno is set)
+   */
+  bool Spawn(pid_t id, char* const* argv, const int* fds, int iCgroupFd, const JobSched_t* pSched);
+
+  /// Runs the launcher loop (in the launcher process).
+  /**
+   * The socket to the daemon is the standard input.
+   *
+   * \param[in] pszUser user name
+   * \return exit status
+   */
+  static int Run(const char* pszUser);
+
+  /// Checks whether the launcher is usable.
+  /**
+   * \return true = launcher running, false = launcher gone
+   */
+  inline bool IsAlive() const
+  {
+    return m_fd != -1;
+  }
+
+private:
+  int m_fd;               ///< socket descriptor
+  pid_t m_pid;            ///< launcher process ID
+  std::string m_user;     ///< user name
+  EventDispatcher* m_pEd; ///< event dispatcher
+  std::set<pid_t> m_jobs; ///< running jobs (IDs)
+  std::deque<uint64_t> m_sent;  ///< send times of requests not answered yet (monotonic milliseconds)
+  TimerId_t m_timer;      ///< response timer (0 = none)
+  bool m_fRetired;        ///< retired (accepts no jobs) yes/no
+
+  static LAUNCHER_MAP s_map;    ///< launchers accepting jobs
+  static PROCSTARTED_LIST s_started;  ///< started jobs
+  static PROCDONE_LIST s_done;  ///< finished jobs
+
+  /// Constructor.
+  /**
+   * \param[in] pEd event dispatcher
+   * \param[in] rUser user name
+   */
+  Launcher(EventDispatcher* pEd, const std::string& rUser);
+
+  /// Destructor.
+  ~Launcher();
+
+  /// Starts the launcher process.
+  /**
+   * \return true = success, false = failure
+   */
+  bool Start();
+
+  /// Processes a reply.
+  /**
+   * \param[in] rRep reply
+   * \param[in] iPidFd passed process descriptor (-1 = none; taken over)
+   */
+  void OnReply(const LaunchReply_t& rRep, int iPidFd);
+
+  /// Closes the launcher connection.
+  /**
+   * All jobs still running are reported as finished.
+   */
+  void Close();
+
+  /// Processes incoming replies (called when the socket is ready).
+  /**
+   * \param[in] iFd socket descriptor
+   * \param[in] revents returned events
+   * \param[in] pArg launcher
+   */
+  static void OnReady(int iFd, short revents, void* pArg);
+
+  /// Checks the launcher's responses (called by the response timer).
+  /**
+   * An unresponsive launcher is killed.
+   *
+   * \param[in] pArg launcher
+   */
+  static void OnTimer(void* pArg);
+};
+
+
+#endif //_LAUNCHER_H_
@@ -0,0 +1,182 @@
+
+/// inotify cron daemon plugin handler implementation
+/**
+ * \file plugin.cpp
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <cstring>
+#include <vector>
+
+#include "plugin.h"
+
+
+/// Removes TSV escapes from a field.
+/**
+ * \param[in] pszField escaped field
+ * \return field value
+ */
+static std::string unescape_tsv(const char* pszField)
+{
+  std::string s;
+  for (const char* p = pszField; *p != '\0'; p++) {
+    if (*p != '\\' || p[1] == '\0') {
+      s.push_back(*p);
+      continue;
+    }
+
+    p++;
+    switch (*p) {
+      case 't':   s.push_back('\t');  break;
+      case 'n':   s.push_back('\n');  break;
+      case 'r':   s.push_back('\r');  break;
+      default:    s.push_back(*p);
+    }
+  }
+  return s;
+}
+
+
+bool Plugin::Parse(const std::string& rCmd, std::string& rPath, std::string& rArg)
+{
+  size_t len = strlen(PLUGIN_CMD);
+  if (rCmd.compare(0, len, PLUGIN_CMD) != 0 || (rCmd.length() > len && rCmd[len] != ' ' && rCmd[len] != '\t'))
+    return false;
+
+  size_t start = rCmd.find_first_not_of(" \t", len);
+  size_t end = start == std::string::npos ? std::string::npos : rCmd.find_first_of(" \t", start);
+  rPath = start == std::string::npos ? std::string() : rCmd.substr(start, end - start);
+
+  start = end == std::string::npos ? std::string::npos : rCmd.find_first_not_of(" \t", end);
+  rArg = start == std::string::npos ? std::string() : rCmd.substr(start);
+
+  return true;
+}
+
+Plugin* Plugin::Load(const std::string& rPath, const std::string& rArg)
+{
+  if (rPath.empty() || rPath[0] != '/') {
+    syslog(LOG_ERR, "cannot load plugin '%s': absolute path required", rPath.c_str());
+    return NULL;
+  }
+
+  void* pLib = dlopen(rPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (pLib == NULL) {
+    syslog(LOG_ERR, "cannot load plugin %s: %s", rPath.c_str(), dlerror());
+    return NULL;
+  }
+
+  incron_plugin_init_t pfnInit = (incron_plugin_init_t) dlsym(pLib, INCRON_PLUGIN_INIT);
+  Plugin* pP = new Plugin(rPath, pLib);
+  pP->m_pfnHandle = (incron_plugin_handle_t) dlsym(pLib, INCRON_PLUGIN_HANDLE);
+  pP->m_pfnShutdown = (incron_plugin_shutdown_t) dlsym(pLib, INCRON_PLUGIN_SHUTDOWN);
+  if (pfnInit == NULL || pP->m_pfnHandle == NULL || pP->m_pfnShutdown == NULL) {
+    syslog(LOG_ERR, "cannot load plugin %s: missing interface functions", rPath.c_str());
+    pP->m_pfnShutdown = NULL;
+    delete pP;
+    return NULL;
+  }
+
+  int res = pfnInit(INCRON_PLUGIN_ABI, rArg.c_str(), &pP->m_pCtx);
+  if (res != 0) {
+    syslog(LOG_ERR, "plugin %s failed to initialize (%i)", rPath.c_str(), res);
+    pP->m_pfnShutdown = NULL;
+    delete pP;
+    return NULL;
+  }
+
+  return pP;
+}
+
+Plugin::Plugin(const std::string& rPath, void* pLib)
+: m_path(rPath),
+  m_pLib(pLib),
+  m_pCtx(NULL),
+  m_pfnHandle(NULL),
+  m_pfnShutdown(NULL)
+{
+
+}
+
+Plugin::~Plugin()
+{
+  if (m_pfnShutdown != NULL)
+    m_pfnShutdown(m_pCtx);
+
+  dlclose(m_pLib);
+}
+
+bool Plugin::Handle(const std::string& rPath, const std::string& rName, uint32_t uMask)
+{
+  incron_event_t evt;
+  evt.path = rPath.c_str();
+  evt.name = rName.c_str();
+  evt.mask = uMask;
+
+  int res = m_pfnHandle(m_pCtx, &evt);
+  if (res != 0)
+    syslog(LOG_WARNING, "plugin %s failed (%i) for %s/%s", m_path.c_str(), res, rPath.c_str(), rName.c_str());
+
+  return res == 0;
+}
+
+int Plugin::RunHost(const char* pszPath, const char* pszArg)
+{
+  // acknowledgements get their own descriptor (plugins may write to stdout)
+  int ackFd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+  int nullFd = open("/dev/null", O_WRONLY);
+  if (ackFd == -1 || nullFd == -1 || dup2(nullFd, STDOUT_FILENO) == -1)
+    return 1;
+  close(nullFd);
+
+  FILE* pAck = fdopen(ackFd, "w");
+  if (pAck == NULL)
+    return 1;
+
+  Plugin* pP = Load(pszPath, pszArg);
+  if (pP == NULL)
+    return 1;
+
+  // records: path, name, event names, mask (separated by tabs)
+  char* pszLine = NULL;
+  size_t size = 0;
+  ssize_t len;
+  while ((len = getline(&pszLine, &size, stdin)) > 0) {
+    if (pszLine[len-1] == '\n')
+      pszLine[len-1] = '\0';
+
+    std::vector<char*> fields;
+    char* p = pszLine;
+    fields.push_back(p);
+    while ((p = strchr(p, '\t')) != NULL) {
+      *p++ = '\0';
+      fields.push_back(p);
+    }
+
+    bool ok = fields.size() >= 4
+        && pP->Handle(unescape_tsv(fields[0]), unescape_tsv(fields[1]), (uint32_t) strtoul(fields[3], NULL, 10));
+
+    fputs(ok ? "ok\n" : "err\n", pAck);
+    fflush(pAck);
+  }
+
+  free(pszLine);
+  delete pP;
+  fclose(pAck);
+  return 0;
+}
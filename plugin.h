@@ -0,0 +1,105 @@
+
+/// inotify cron daemon plugin handler header
+/**
+ * \file plugin.h
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+#ifndef _PLUGIN_H_
+#define _PLUGIN_H_
+
+#include <string>
+#include <stdint.h>
+
+#include "incron-plugin.h"
+
+/// Command prefix of plugin entries
+#define PLUGIN_CMD "@plugin"
+
+/// Option starting the plugin host mode
+#define PLUGIN_HOST_OPTION "--plugin-host"
+
+
+/// Plugin handler class.
+/**
+ * A plugin is a shared object handling events in-process
+ * (see incron-plugin.h). Plugins of system tables are loaded
+ * into the daemon itself.
+ *
+ * Plugins of user tables must not run with the daemon's
+ * privileges. They are loaded by a plugin host instead - the
+ * daemon's executable started in the host mode as a coprocess
+ * with the user's credentials. The host reads event records
+ * (in the coprocess TSV format) and acknowledges each of them.
+ * The plugin's own standard output goes to /dev/null.
+ */
+class Plugin
+{
+public:
+  /// Parses a plugin command.
+  /**
+   * \param[in] rCmd command string
+   * \param[out] rPath shared object path
+   * \param[out] rArg plugin argument
+   * \return true = plugin command, false = other command
+   */
+  static bool Parse(const std::string& rCmd, std::string& rPath, std::string& rArg);
+
+  /// Loads and initializes a plugin.
+  /**
+   * Errors are logged.
+   *
+   * \param[in] rPath shared object path (absolute)
+   * \param[in] rArg plugin argument
+   * \return plugin; NULL on error
+   */
+  static Plugin* Load(const std::string& rPath, const std::string& rArg);
+
+  /// Destructor.
+  /**
+   * The plugin is shut down and unloaded.
+   */
+  ~Plugin();
+
+  /// Passes an event to the plugin.
+  /**
+   * \param[in] rPath watched path
+   * \param[in] rName file name
+   * \param[in] uMask event mask
+   * \return true = success, false = failure
+   */
+  bool Handle(const std::string& rPath, const std::string& rName, uint32_t uMask);
+
+  /// Runs the plugin host.
+  /**
+   * \param[in] pszPath shared object path
+   * \param[in] pszArg plugin argument
+   * \return exit status
+   */
+  static int RunHost(const char* pszPath, const char* pszArg);
+
+private:
+  std::string m_path;       ///< shared object path
+  void* m_pLib;             ///< library handle
+  void* m_pCtx;             ///< plugin context
+  incron_plugin_handle_t m_pfnHandle;     ///< event handling function
+  incron_plugin_shutdown_t m_pfnShutdown; ///< shutdown function
+
+  /// Constructor.
+  /**
+   * \param[in] rPath shared object path
+   * \param[in] pLib library handle
+   */
+  Plugin(const std::string& rPath, void* pLib);
+};
+
+
+#endif //_PLUGIN_H_
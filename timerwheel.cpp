@@ -0,0 +1,284 @@
+
+/// inotify cron daemon timer wheel implementation
+/**
+ * \file timerwheel.cpp
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <cstring>
+
+#include "timerwheel.h"
+
+/// Mask for slot indices
+#define TW_MASK (TW_SLOTS - 1)
+
+/// Slot index of a time at a level
+#define TW_INDEX(t, level) ((int) (((t) >> (TW_BITS * (level))) & TW_MASK))
+
+
+TimerWheel::TimerWheel()
+: m_now(Now()),
+  m_armed(0),
+  m_count(0),
+  m_free(-1)
+{
+  m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (m_fd == -1)
+    throw InotifyException("cannot create timer", errno, NULL);
+
+  for (int i=0; i<TW_LEVELS * TW_SLOTS; i++) {
+    m_slots[i] = -1;
+  }
+  memset(m_used, 0, sizeof(m_used));
+}
+
+TimerWheel::~TimerWheel()
+{
+  close(m_fd);
+}
+
+TimerId_t TimerWheel::Schedule(uint64_t uMsec, timer_cb cb, void* pArg)
+{
+  // nothing can expire - resynchronize the wheel time
+  if (m_count == 0)
+    m_now = Now();
+
+  if (uMsec < 1)
+    uMsec = 1;
+  else if (uMsec > TW_MAX_DELAY)
+    uMsec = TW_MAX_DELAY;
+
+  int32_t idx = Alloc();
+  TimerNode_t& rN = m_nodes[idx];
+  rN.expire = Now() + uMsec;
+  rN.cb = cb;
+  rN.pArg = pArg;
+  Link(idx);
+
+  if (m_armed == 0 || rN.expire < m_armed)
+    Arm();
+
+  return (((TimerId_t) rN.gen) << 32) | (TimerId_t) idx;
+}
+
+bool TimerWheel::Cancel(TimerId_t id)
+{
+  int32_t idx = (int32_t) (id & 0xffffffff);
+  if (id == 0 || idx >= (int32_t) m_nodes.size())
+    return false;
+
+  TimerNode_t& rN = m_nodes[idx];
+  if (rN.slot == -1 || rN.gen != (uint32_t) (id >> 32))
+    return false;
+
+  // the descriptor is not re-armed - an early wakeup does no harm
+  Unlink(idx);
+  Release(idx);
+  return true;
+}
+
+void TimerWheel::Process()
+{
+  uint64_t exp;
+  if (read(m_fd, &exp, sizeof(exp)) == -1 && errno != EAGAIN)
+    return;
+
+  m_armed = 0;
+  Advance(Now());
+  Arm();
+}
+
+uint64_t TimerWheel::Now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000 + ((uint64_t) ts.tv_nsec) / 1000000;
+}
+
+int32_t TimerWheel::Alloc()
+{
+  int32_t idx = m_free;
+  if (idx != -1) {
+    m_free = m_nodes[idx].next;
+  }
+  else {
+    TimerNode_t n;
+    n.gen = 1;
+    m_nodes.push_back(n);
+    idx = (int32_t) m_nodes.size() - 1;
+  }
+
+  m_count++;
+  return idx;
+}
+
+void TimerWheel::Release(int32_t idx)
+{
+  TimerNode_t& rN = m_nodes[idx];
+  rN.slot = -1;
+  if (++rN.gen == 0)
+    rN.gen = 1;
+  rN.next = m_free;
+  m_free = idx;
+  m_count--;
+}
+
+void TimerWheel::Link(int32_t idx)
+{
+  TimerNode_t& rN = m_nodes[idx];
+  uint64_t delta = rN.expire > m_now ? rN.expire - m_now : 0;
+
+  int level = 0;
+  while (level < TW_LEVELS - 1 && delta >= ((uint64_t) 1 << (TW_BITS * (level + 1)))) {
+    level++;
+  }
+
+  int slot = level * TW_SLOTS + TW_INDEX(rN.expire, level);
+  rN.slot = slot;
+  rN.prev = -1;
+  rN.next = m_slots[slot];
+  if (rN.next != -1)
+    m_nodes[rN.next].prev = idx;
+  m_slots[slot] = idx;
+  m_used[slot >> 6] |= ((uint64_t) 1) << (slot & 63);
+}
+
+void TimerWheel::Unlink(int32_t idx)
+{
+  TimerNode_t& rN = m_nodes[idx];
+  if (rN.prev != -1)
+    m_nodes[rN.prev].next = rN.next;
+  else
+    m_slots[rN.slot] = rN.next;
+  if (rN.next != -1)
+    m_nodes[rN.next].prev = rN.prev;
+
+  if (m_slots[rN.slot] == -1)
+    m_used[rN.slot >> 6] &= ~(((uint64_t) 1) << (rN.slot & 63));
+}
+
+int TimerWheel::Cascade(int level)
+{
+  int index = TW_INDEX(m_now, level);
+  int slot = level * TW_SLOTS + index;
+
+  int32_t idx;
+  while ((idx = m_slots[slot]) != -1) {
+    Unlink(idx);
+    Link(idx);
+  }
+
+  return index;
+}
+
+void TimerWheel::Advance(uint64_t uTo)
+{
+  while (m_now < uTo) {
+    int cur = TW_INDEX(m_now, 0);
+    int s = cur < TW_MASK ? FindSlot(0, cur + 1) : -1;
+    uint64_t next = s != -1
+        ? m_now - cur + s               // nearest timer in this round
+        : (m_now | TW_MASK) + 1;        // next round (cascading)
+
+    if (next > uTo) {
+      m_now = uTo;
+      break;
+    }
+
+    m_now = next;
+
+    if (TW_INDEX(m_now, 0) == 0) {
+      int level = 1;
+      while (level < TW_LEVELS && Cascade(level) == 0) {
+        level++;
+      }
+    }
+
+    int32_t* pHead = &m_slots[TW_INDEX(m_now, 0)];
+    int32_t idx;
+    while ((idx = *pHead) != -1) {
+      timer_cb cb = m_nodes[idx].cb;
+      void* pArg = m_nodes[idx].pArg;
+      Unlink(idx);
+      Release(idx);
+      cb(pArg);
+    }
+  }
+}
+
+int TimerWheel::FindSlot(int level, int from) const
+{
+  int s = from;
+  while (s < TW_SLOTS) {
+    int g = level * TW_SLOTS + s;
+    uint64_t w = m_used[g >> 6] >> (g & 63);
+    if (w != 0)
+      return s + __builtin_ctzll(w);
+    s = (s | 63) + 1;
+  }
+
+  return -1;
+}
+
+uint64_t TimerWheel::GetNextTime() const
+{
+  if (m_count == 0)
+    return 0;
+
+  int cur = TW_INDEX(m_now, 0);
+  int s = cur < TW_MASK ? FindSlot(0, cur + 1) : -1;
+  if (s != -1)
+    return m_now - cur + s;
+
+  // anything left at the lowest level belongs to the next round
+  uint64_t t = FindSlot(0, 0) != -1 ? (m_now | TW_MASK) + 1 : 0;
+
+  for (int level = 1; level < TW_LEVELS; level++) {
+    int shift = TW_BITS * level;
+    uint64_t span = ((uint64_t) 1) << (shift + TW_BITS);
+    uint64_t base = m_now & ~(span - 1);
+
+    cur = TW_INDEX(m_now, level);
+    s = cur < TW_MASK ? FindSlot(level, cur + 1) : -1;
+    if (s == -1) {
+      s = FindSlot(level, 0);
+      if (s == -1)
+        continue;
+      base += span;
+    }
+
+    uint64_t u = base + (((uint64_t) s) << shift);
+    if (t == 0 || u < t)
+      t = u;
+  }
+
+  return t;
+}
+
+void TimerWheel::Arm()
+{
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+
+  uint64_t t = GetNextTime();
+  if (t == 0 && m_armed == 0)
+    return;
+
+  its.it_value.tv_sec = (time_t) (t / 1000);
+  its.it_value.tv_nsec = (long) ((t % 1000) * 1000000);
+  if (timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0)
+    m_armed = t;
+}
@@ -0,0 +1,193 @@
+
+/// inotify cron daemon timer wheel header
+/**
+ * \file timerwheel.h
+ *
+ * inotify cron system
+ *
+ * Copyright (C) 2014, 2015 Andreas Altair Redmer, <altair.ibn.la.ahad.sy@gmail.com>
+ *
+ * This program is free software; you can use it, redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License, version 2 (see LICENSE-GPL).
+ *
+ */
+
+#ifndef _TIMERWHEEL_H_
+#define _TIMERWHEEL_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "inotify-cxx.h"
+
+/// Count of wheel levels
+#define TW_LEVELS 4
+
+/// Count of bits per wheel level
+#define TW_BITS 8
+
+/// Count of slots per wheel level
+#define TW_SLOTS (1 << TW_BITS)
+
+/// Maximum timer delay (in milliseconds, half of the wheel range)
+#define TW_MAX_DELAY ((uint64_t) 1 << (TW_LEVELS * TW_BITS - 1))
+
+/// Callback for calling when a timer expires.
+typedef void (*timer_cb)(void* pArg);
+
+/// Timer identifier (0 = no timer)
+typedef uint64_t TimerId_t;
+
+/// Timer data
+typedef struct
+{
+  uint64_t expire;  ///< expiration time (monotonic milliseconds)
+  timer_cb cb;      ///< function called on expiration
+  void* pArg;       ///< callback argument
+  uint32_t gen;     ///< generation (for identifying stale timers)
+  int32_t prev;     ///< previous timer in the slot
+  int32_t next;     ///< next timer in the slot (or in the free list)
+  int32_t slot;     ///< slot index (-1 = timer not scheduled)
+} TimerNode_t;
+
+/// Hierarchical timer wheel.
+/**
+ * Timers have a resolution of one millisecond. Scheduling and
+ * cancelling are O(1) operations, expired timers are cascaded
+ * down from coarser levels as the time goes.
+ *
+ * The wheel is driven by a timer file descriptor which becomes
+ * readable when the nearest timer may have expired. It is intended
+ * to be monitored in the main poll() loop; Process() must be called
+ * when it is readable.
+ */
+class TimerWheel
+{
+public:
+  /// Constructor.
+  /**
+   * \throw InotifyException thrown if the timer descriptor cannot be created
+   */
+  TimerWheel();
+
+  /// Destructor.
+  ~TimerWheel();
+
+  /// Schedules a timer.
+  /**
+   * Delays longer than TW_MAX_DELAY are shortened to this value.
+   *
+   * \param[in] uMsec delay in milliseconds
+   * \param[in] cb function called on expiration
+   * \param[in] pArg callback argument
+   * \return timer identifier
+   */
+  TimerId_t Schedule(uint64_t uMsec, timer_cb cb, void* pArg);
+
+  /// Cancels a timer.
+  /**
+   * Cancelling an expired (or unknown) timer does nothing.
+   *
+   * \param[in] id timer identifier
+   * \return true = timer cancelled, false = no such timer
+   */
+  bool Cancel(TimerId_t id);
+
+  /// Processes expired timers.
+  /**
+   * It calls callbacks of all expired timers. Callbacks may
+   * schedule and cancel timers freely.
+   */
+  void Process();
+
+  /// Returns the timer descriptor.
+  /**
+   * \return timer descriptor
+   */
+  inline int GetDescriptor() const
+  {
+    return m_fd;
+  }
+
+  /// Returns the count of scheduled timers.
+  /**
+   * \return count of timers
+   */
+  inline size_t GetCount() const
+  {
+    return m_count;
+  }
+
+  /// Returns the current monotonic time.
+  /**
+   * \return time in milliseconds
+   */
+  static uint64_t Now();
+
+private:
+  int m_fd;                         ///< timer descriptor
+  uint64_t m_now;                   ///< current wheel time
+  uint64_t m_armed;                 ///< time the descriptor is armed for (0 = disarmed)
+  size_t m_count;                   ///< count of scheduled timers
+  int32_t m_free;                   ///< first free node
+  std::vector<TimerNode_t> m_nodes; ///< timer nodes
+  int32_t m_slots[TW_LEVELS * TW_SLOTS];  ///< slot list heads
+  uint64_t m_used[TW_LEVELS * TW_SLOTS / 64]; ///< slot occupancy bitmap
+
+  /// Links a node into the appropriate slot.
+  /**
+   * \param[in] idx node index
+   */
+  void Link(int32_t idx);
+
+  /// Unlinks a node from its slot.
+  /**
+   * \param[in] idx node index
+   */
+  void Unlink(int32_t idx);
+
+  /// Moves timers from a slot to finer levels.
+  /**
+   * \param[in] level wheel level
+   * \return slot index at the level
+   */
+  int Cascade(int level);
+
+  /// Advances the wheel time and fires expired timers.
+  /**
+   * \param[in] uTo new wheel time
+   */
+  void Advance(uint64_t uTo);
+
+  /// Finds the nearest occupied slot at a level.
+  /**
+   * \param[in] level wheel level
+   * \param[in] from first slot index examined
+   * \return slot index; -1 if there is no occupied slot
+   */
+  int FindSlot(int level, int from) const;
+
+  /// Allocates a timer node.
+  /**
+   * \return node index
+   */
+  int32_t Alloc();
+
+  /// Releases a timer node.
+  /**
+   * \param[in] idx node index
+   */
+  void Release(int32_t idx);
+
+  /// Computes the time of the nearest wheel activity.
+  /**
+   * \return time in milliseconds; 0 if no timer is scheduled
+   */
+  uint64_t GetNextTime() const;
+
+  /// Arms the timer descriptor for the nearest activity.
+  void Arm();
+};
+
+#endif //_TIMERWHEEL_H_
@@ -24,18 +24,29 @@
 #include <syslog.h>
 #include <errno.h>
 #include <sys/wait.h>
+#include <signal.h>
 #include <unistd.h>
 #include <grp.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <cstdio>
 #include <cstring>
 #include <algorithm>
+#include <fcntl.h>
+#include <sys/syscall.h>
 
 #include "usertable.h"
 #include "incroncfg.h"
 #include "incrontab.h"
 #include "executor.h"
+#include "jobspawn.h"
+#include "launcher.h"
+#include "coproc.h"
+#include "credcache.h"
+#include "cgroup.h"
+#include "joblog.h"
+#include "plugin.h"
 
 #ifdef IN_DONT_FOLLOW
 #define DONT_FOLLOW(mask) InotifyEvent::IsType(mask, IN_DONT_FOLLOW)
@@ -43,22 +54,381 @@
 #define DONT_FOLLOW(mask) (false)
 #endif // IN_DONT_FOLLOW
 
-// this is not enough, but...
-#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin:/usr/X11R6/bin"
+/// Shell for system table commands
+#define SYS_SHELL "/bin/sh"
+
+/// Shell for user table commands
+#define USER_SHELL "/bin/bash"
+
+/// Characters requiring the shell
+#define SHELL_META "|&;<>()`\\\"'*?[]{}~\n"
+
+/// Default batch accumulation time (milliseconds)
+#define BATCH_DEFAULT_TIME 1000
+
+/// Default time between terminating and killing a job (seconds)
+#define KILL_AFTER_DEFAULT 5
+
+/// Interval of revalidating cached access decisions (microseconds)
+#define ACCESS_RECHECK 1000000
+
+/// Delay before reloading a table for new subdirectories (milliseconds)
+#define RELOAD_DELAY 1000
 
 
 PROC_MAP UserTable::s_procMap;
+WATCHPROC_MAP UserTable::s_watchProcs;
+JOB_QUEUE UserTable::s_jobQueue;
+size_t UserTable::s_uQueued = 0;
+unsigned UserTable::s_uMaxJobs = 0;
+unsigned UserTable::s_uJobId = 0;
+std::string UserTable::s_cmdBuf;
+std::string UserTable::s_typesBuf;
 
 extern volatile bool g_fFinish;
 extern SUT_MAP g_ut;
 
 
-#ifdef LOOPER
-void on_proc_done(InotifyWatch* pW)
+/// Releases a reference to an entry runtime state.
+/**
+ * The state is destroyed when the last reference is released.
+ * 
+ * \param[in] pState entry runtime state
+ */
+static void release_state(EntryState_t* pState)
+{
+  if (--pState->refs == 0)
+    delete pState;
+}
+
+void init_bucket(TokenBucket_t& rB, double rate, unsigned burst)
+{
+  rB.rate = rate > 0 ? rate : 0;
+  rB.burst = burst > 0 ? (double) burst : (rate > 1 ? rate : 1);
+  rB.tokens = rB.burst;
+  rB.last = 0;
+}
+
+void refill_bucket(TokenBucket_t& rB, uint64_t now)
 {
-  pW->SetEnabled(true);
+  if (rB.last != 0 && now > rB.last) {
+    rB.tokens += rB.rate * (now - rB.last) / 1000;
+    if (rB.tokens > rB.burst)
+      rB.tokens = rB.burst;
+  }
+  rB.last = now;
+}
+
+/// Appends a literal command word.
+/**
+ * \param[in,out] rWords command words
+ * \param[in] rText word text
+ */
+static void add_literal(std::vector<CMD_WORD>& rWords, const std::string& rText)
+{
+  CmdSegment_t seg;
+  seg.wildcard = 0;
+  seg.text = rText;
+  rWords.push_back(CMD_WORD(1, seg));
+}
+
+/// Parses a CPU list.
+/**
+ * \param[in] rList list of CPUs and ranges separated by '+', e.g. "0-3+6"
+ * \param[out] rSet CPU set
+ * \return true = success, false = invalid list
+ */
+static bool parse_cpus(const std::string& rList, cpu_set_t& rSet)
+{
+  CPU_ZERO(&rSet);
+  
+  const char* p = rList.c_str();
+  do {
+    char* end;
+    unsigned long lo = strtoul(p, &end, 10);
+    if (end == p)
+      return false;
+    unsigned long hi = lo;
+    if (*end == '-') {
+      p = end + 1;
+      hi = strtoul(p, &end, 10);
+      if (end == p)
+        return false;
+    }
+    if (lo > hi || hi >= CPU_SETSIZE)
+      return false;
+    for (unsigned long i=lo; i<=hi; i++) {
+      CPU_SET(i, &rSet);
+    }
+    p = end;
+  } while (*p++ == '+');
+  
+  return p[-1] == '\0';
+}
+
+/// Initializes job scheduling attributes of an entry.
+/**
+ * Invalid attributes are left inherited.
+ * 
+ * \param[out] rS scheduling attributes
+ * \param[in] rE table entry
+ * \return NULL = success; otherwise the name of the first invalid attribute
+ */
+static const char* init_sched(JobSched_t& rS, const IncronTabEntry& rE)
+{
+  const char* pszBad = NULL;
+  JobSpawner::InitSched(rS);
+  
+  if (rE.HasNice()) {
+    if (rE.GetNice() >= -20 && rE.GetNice() <= 19) {
+      rS.fNice = true;
+      rS.nice = rE.GetNice();
+    }
+    else {
+      pszBad = "nice";
+    }
+  }
+  
+  // I/O priority as class << 13 | level (see ioprio_set(2))
+  const std::string& io = rE.GetIoNice();
+  if (!io.empty()) {
+    int cls = 0;
+    if (io.compare(0, 2, "rt") == 0)
+      cls = 1;
+    else if (io.compare(0, 2, "be") == 0)
+      cls = 2;
+    
+    int level = 4;
+    if (cls != 0 && io.length() > 3 && io[2] == ':')
+      level = (int) strtol(io.c_str() + 3, NULL, 10);
+    
+    if (io == "idle")
+      rS.ioprio = 3 << 13;
+    else if (cls != 0 && (io.length() == 2 || io[2] == ':') && level >= 0 && level <= 7)
+      rS.ioprio = cls << 13 | level;
+    else if (pszBad == NULL)
+      pszBad = "ionice";
+  }
+  
+  if (rE.GetSched() == "batch")
+    rS.policy = SCHED_BATCH;
+  else if (rE.GetSched() == "idle")
+    rS.policy = SCHED_IDLE;
+  else if (!rE.GetSched().empty() && pszBad == NULL)
+    pszBad = "sched";
+  
+  if (!rE.GetCpus().empty()) {
+    if (parse_cpus(rE.GetCpus(), rS.cpus))
+      rS.fCpus = true;
+    else if (pszBad == NULL)
+      pszBad = "cpus";
+  }
+  
+  return pszBad;
+}
+
+/// Returns the identity of an entry.
+/**
+ * Entries of the same identity share their runtime state
+ * across table reloads.
+ * 
+ * \param[in] rE table entry
+ * \return identity (path, mask and command)
+ */
+static std::string entry_ident(const IncronTabEntry& rE)
+{
+  char s[16];
+  snprintf(s, sizeof(s), "\t%08x\t", (unsigned) rE.GetMask());
+  return rE.GetPath() + s + rE.GetCmd();
+}
+
+/// Creates an entry runtime state.
+/**
+ * Only runtime data (no jobs, no pending batch etc.) is set up
+ * here, the settings are applied by the initializers below.
+ * 
+ * \param[in] pTab owning table
+ * \return entry runtime state (with one reference)
+ */
+static EntryState_t* new_state(UserTable* pTab)
+{
+  EntryState_t* pState = new EntryState_t;
+  pState->pTab = pTab;
+  pState->refs = 1;
+  pState->limits.running = 0;
+  pState->limits.cgFd = -1;
+  pState->batch.timer = 0;
+  pState->coproc.pCoproc = NULL;
+  pState->rate.bucket.rate = 0;
+  pState->rate.pDelayed = NULL;
+  pState->plugin.fInProcess = false;
+  pState->plugin.pPlugin = NULL;
+  memset(&pState->usage, 0, sizeof(pState->usage));
+  return pState;
+}
+
+/// Initializes the command of an entry.
+/**
+ * \param[out] rC command data
+ * \param[in] rE table entry
+ */
+static void init_cmd(CmdState_t& rC, const IncronTabEntry& rE)
+{
+  rC.words.clear();
+  rC.shellCmd.clear();
+  rC.fDirect = UserTable::ParseDirect(rE.GetCmd(), rC.words);
+  if (!rC.fDirect)
+    UserTable::CompileShell(rE.GetCmd(), rC.shellCmd);
+  rC.fileOp = FO_NONE;
+  rC.fDisabled = false;
+}
+
+/// Checks whether a command contains wildcards.
+/**
+ * \param[in] rC command data
+ * \return true = wildcards found, false = literal command
+ */
+static bool has_wildcards(const CmdState_t& rC)
+{
+  if (!rC.fDirect) {
+    for (size_t i=0; i<rC.shellCmd.size(); i++) {
+      if (rC.shellCmd[i].wildcard != 0)
+        return true;
+    }
+    return false;
+  }
+  
+  for (size_t i=0; i<rC.words.size(); i++) {
+    for (size_t j=0; j<rC.words[i].size(); j++) {
+      if (rC.words[i][j].wildcard != 0)
+        return true;
+    }
+  }
+  return false;
+}
+
+/// Initializes job limits of an entry.
+/**
+ * The count of running jobs and the cgroup are not touched.
+ * 
+ * \param[in,out] rL job limits
+ * \param[in] rE table entry
+ * \return NULL = success; otherwise the name of the first invalid scheduling attribute
+ */
+static const char* init_limits(LimitState_t& rL, const IncronTabEntry& rE)
+{
+  rL.fPriority = rE.IsPriority();
+  rL.maxJobs = rE.GetMaxJobs();
+  rL.timeout = rE.GetTimeout();
+  rL.killAfter = rE.GetKillAfter() > 0 ? rE.GetKillAfter() : KILL_AFTER_DEFAULT;
+  rL.cooldown = rE.GetCooldown();
+  rL.fSched = rE.HasSched();
+  return init_sched(rL.sched, rE);
+}
+
+/// Initializes batching of an entry.
+/**
+ * \param[in,out] rB batching state
+ * \param[in] rE table entry
+ */
+static void init_batch(BatchState_t& rB, const IncronTabEntry& rE)
+{
+  rB.size = rE.GetBatchSize();
+  rB.time = 0;
+  if (rE.IsBatch())
+    rB.time = rE.GetBatchTime() > 0 ? rE.GetBatchTime() : BATCH_DEFAULT_TIME;
+  rB.mode = rE.GetBatchMode();
+}
+
+/// Initializes the coprocess settings of an entry.
+/**
+ * \param[in,out] rC coprocess state
+ * \param[in] rE table entry
+ */
+static void init_coproc(CoprocState_t& rC, const IncronTabEntry& rE)
+{
+  rC.mode = rE.GetCoprocMode();
+  rC.fAck = rE.IsAck();
+}
+
+/// Initializes job keys of an entry.
+/**
+ * \param[in,out] rK key state
+ * \param[in] rE table entry
+ */
+static void init_key(KeyState_t& rK, const IncronTabEntry& rE)
+{
+  rK.mode = KM_NONE;
+  rK.templ.clear();
+  if (!rE.GetCollapseKey().empty()) {
+    rK.mode = KM_COLLAPSE;
+    UserTable::CompileShell(rE.GetCollapseKey(), rK.templ);
+  }
+  else if (!rE.GetOrderKey().empty()) {
+    rK.mode = KM_ORDER;
+    UserTable::CompileShell(rE.GetOrderKey(), rK.templ);
+  }
+}
+
+/// Initializes rate limiting of an entry.
+/**
+ * \param[in,out] rR rate limiting state
+ * \param[in] rE table entry
+ */
+static void init_rate(RateState_t& rR, const IncronTabEntry& rE)
+{
+  // a carried over bucket keeps its level
+  TokenBucket_t old = rR.bucket;
+  init_bucket(rR.bucket, rE.GetRate(), rE.GetBurst());
+  if (old.rate > 0 && rR.bucket.rate > 0) {
+    rR.bucket.tokens = old.tokens < rR.bucket.burst ? old.tokens : rR.bucket.burst;
+    rR.bucket.last = old.last;
+  }
+  rR.policy = rE.GetRatePolicy();
+}
+
+/// Converts a time value to microseconds.
+/**
+ * \param[in] rTv time value
+ * \return microseconds
+ */
+static uint64_t tv_usec(const struct timeval& rTv)
+{
+  return (uint64_t) rTv.tv_sec * 1000000 + rTv.tv_usec;
+}
+
+/// Accounts a finished job.
+/**
+ * \param[in,out] rU resource usage totals
+ * \param[in] status exit status (-1 = unknown)
+ * \param[in] wall wall clock time (milliseconds)
+ * \param[in] pRu resource usage of the job (NULL = unknown)
+ */
+static void add_usage(JobUsage_t& rU, int status, uint64_t wall, const struct rusage* pRu)
+{
+  rU.jobs++;
+  if (status != 0)
+    rU.failed++;
+  rU.wall += wall;
+  
+  if (pRu != NULL) {
+    rU.user += tv_usec(pRu->ru_utime);
+    rU.sys += tv_usec(pRu->ru_stime);
+    if ((uint64_t) pRu->ru_maxrss > rU.maxRss)
+      rU.maxRss = pRu->ru_maxrss;
+    rU.inBlock += pRu->ru_inblock;
+    rU.outBlock += pRu->ru_oublock;
+  }
+}
+
+/// Processes expired timers.
+/**
+ * \param[in] pArg timer wheel
+ */
+void on_timer(int, short, void* pArg)
+{
+  ((TimerWheel*) pArg)->Process();
 }
-#endif
 
 
 EventDispatcher::EventDispatcher(int iPipeFd, Inotify* pIn, InotifyWatch* pSys, InotifyWatch* pUser)
@@ -70,6 +440,9 @@ EventDispatcher::EventDispatcher(int iPipeFd, Inotify* pIn, InotifyWatch* pSys,
   m_pUser = pUser;
   m_size = 0;
   m_pPoll = NULL;
+  m_fRebuild = true;
+
+  RegisterFd(m_timers.GetDescriptor(), POLLIN, on_timer, &m_timers);
 }
 
 EventDispatcher::~EventDispatcher()
@@ -88,30 +461,52 @@ bool EventDispatcher::ProcessEvents()
     m_pPoll[0].revents = 0;
   }
 
-  // process table management events if any
-  if (m_pPoll[1].revents & POLLIN) {
-    ProcessMgmtEvents();
-    m_pPoll[1].revents = 0;
-  }
-
   InotifyEvent evt;
 
+  // read events and process the high priority ones (fast lane)
   for (size_t i=2; i<m_size; i++) {
-
-    // process events if occurred
     if (m_pPoll[i].revents & POLLIN) {
       FDUT_MAP::iterator it = m_maps.find(m_pPoll[i].fd);
       if (it != m_maps.end()) {
         Inotify* pIn = ((*it).second)->GetInotify();
         pIn->WaitForEvents(true);
 
-        // process events for this object
+        while (pIn->GetPriorityEvent(evt)) {
+          ((*it).second)->OnEvent(evt);
+        }
+      }
+    }
+  }
+
+  // process table management events if any
+  if (m_pPoll[1].revents & POLLIN) {
+    ProcessMgmtEvents();
+    m_pPoll[1].revents = 0;
+  }
+
+  for (size_t i=2; i<m_size; i++) {
+    if (m_pPoll[i].revents == 0)
+      continue;
+
+    // process remaining events (tables may be gone meanwhile)
+    FDUT_MAP::iterator it = m_maps.find(m_pPoll[i].fd);
+    if (it != m_maps.end()) {
+      if (m_pPoll[i].revents & POLLIN) {
+        Inotify* pIn = ((*it).second)->GetInotify();
         while (pIn->GetEvent(evt)) {
           ((*it).second)->OnEvent(evt);
         }
       }
-      m_pPoll[i].revents = 0;
     }
+    else {
+      // other descriptors (callbacks may change registrations)
+      FDCB_MAP::iterator it2 = m_fds.find(m_pPoll[i].fd);
+      if (it2 != m_fds.end()) {
+        FdData_t fdd = (*it2).second;
+        fdd.cb(m_pPoll[i].fd, m_pPoll[i].revents, fdd.pArg);
+      }
+    }
+    m_pPoll[i].revents = 0;
   }
 
   return pipe;
@@ -125,7 +520,7 @@ void EventDispatcher::Register(UserTable* pTab)
       int fd = pIn->GetDescriptor();
       if (fd != -1) {
         m_maps.insert(FDUT_MAP::value_type(fd, pTab));
-        Rebuild();
+        m_fRebuild = true;
       }
     }
   }
@@ -136,10 +531,26 @@ void EventDispatcher::Unregister(UserTable* pTab)
   FDUT_MAP::iterator it = m_maps.find(pTab->GetInotify()->GetDescriptor());
   if (it != m_maps.end()) {
     m_maps.erase(it);
-    Rebuild();
+    m_fRebuild = true;
   }
 }
 
+void EventDispatcher::RegisterFd(int iFd, short events, fd_cb cb, void* pArg)
+{
+  FdData_t fdd;
+  fdd.cb = cb;
+  fdd.pArg = pArg;
+  fdd.events = events;
+  m_fds[iFd] = fdd;
+  m_fRebuild = true;
+}
+
+void EventDispatcher::UnregisterFd(int iFd)
+{
+  if (m_fds.erase(iFd) > 0)
+    m_fRebuild = true;
+}
+
 void EventDispatcher::Rebuild()
 {
   // delete old data if exists
@@ -147,7 +558,7 @@ void EventDispatcher::Rebuild()
     delete[] m_pPoll;
 
   // allocate memory
-  m_size = m_maps.size() + 2;
+  m_size = m_maps.size() + m_fds.size() + 2;
   m_pPoll = new struct pollfd[m_size];
 
   // add pipe descriptor
@@ -161,12 +572,23 @@ void EventDispatcher::Rebuild()
   m_pPoll[1].revents = 0;
 
   // add all inotify descriptors
+  size_t i = 2;
   FDUT_MAP::iterator it = m_maps.begin();
-  for (size_t i=2; i<m_size; i++, it++) {
+  for (; it != m_maps.end(); i++, it++) {
     m_pPoll[i].fd = (*it).first;
     m_pPoll[i].events = POLLIN;
     m_pPoll[i].revents = 0;
   }
+  
+  // add other descriptors
+  FDCB_MAP::iterator it2 = m_fds.begin();
+  for (; it2 != m_fds.end(); i++, it2++) {
+    m_pPoll[i].fd = (*it2).first;
+    m_pPoll[i].events = (*it2).second.events;
+    m_pPoll[i].revents = 0;
+  }
+  
+  m_fRebuild = false;
 }
 
 void EventDispatcher::ProcessMgmtEvents()
@@ -193,8 +615,7 @@ void EventDispatcher::ProcessMgmtEvents()
           UserTable* pUt = (*it).second;
           if (e.IsType(IN_CLOSE_WRITE) || e.IsType(IN_MOVED_TO)) {
             syslog(LOG_INFO, "system table %s changed, reloading", e.GetName().c_str());
-            pUt->Dispose();
-            pUt->Load();
+            pUt->Reload();
           }
           else if (e.IsType(IN_MOVED_FROM) || e.IsType(IN_DELETE)) {
             syslog(LOG_INFO, "system table %s destroyed, removing", e.GetName().c_str());
@@ -221,8 +642,7 @@ void EventDispatcher::ProcessMgmtEvents()
           UserTable* pUt = (*it).second;
           if (e.IsType(IN_CLOSE_WRITE) || e.IsType(IN_MOVED_TO)) {
             syslog(LOG_INFO, "table for user %s changed, reloading", e.GetName().c_str());
-            pUt->Dispose();
-            pUt->Load();
+            pUt->Reload();
           }
           else if (e.IsType(IN_MOVED_FROM) || e.IsType(IN_DELETE)) {
             syslog(LOG_INFO, "table for user %s destroyed, removing",  e.GetName().c_str());
@@ -248,17 +668,84 @@ void EventDispatcher::ProcessMgmtEvents()
 
 UserTable::UserTable(EventDispatcher* pEd, const std::string& rUser, bool fSysTable)
 : m_user(rUser),
-  m_fSysTable(fSysTable)
+  m_fSysTable(fSysTable),
+  m_reloadTimer(0),
+  m_uMaxJobs(0),
+  m_uRunning(0),
+  m_uQueued(0),
+  m_fLauncher(false),
+  m_cgFd(-1)
 {
   m_pEd = pEd;
+  m_cgName = (m_fSysTable ? "system." : "user.") + m_user;
+  m_pLog = JobLog::Create(m_cgName);
+  memset(&m_stats, 0, sizeof(m_stats));
+  
+  IncronCfg::GetValue("max_jobs", s_uMaxJobs);
+  IncronCfg::GetValue("max_table_jobs", m_uMaxJobs);
+  
+  std::string rate;
+  unsigned burst = 0;
+  IncronCfg::GetValue("table_rate", rate);
+  IncronCfg::GetValue("table_burst", burst);
+  init_bucket(m_bucket, strtod(rate.c_str(), NULL), burst);
+  
+  if (!m_fSysTable)
+    IncronCfg::GetValue("user_launchers", m_fLauncher);
 
   m_in.SetNonBlock(true);
   m_in.SetCloseOnExec(true);
+
+  unsigned limit = 0;
+  std::string dir;
+  if (IncronCfg::GetValue("backlog_limit", limit) && IncronCfg::GetValue("backlog_spill_dir", dir))
+    m_in.SetBacklogLimit((size_t) limit, dir);
+
+  unsigned bytes = 0, usec = 0;
+  if (IncronCfg::GetValue("read_batch_size", bytes) && IncronCfg::GetValue("read_batch_time", usec))
+    m_in.SetBatchLimits((size_t) bytes, usec);
 }
 
 UserTable::~UserTable()
 {
+  m_pEd->GetTimers()->Cancel(m_reloadTimer);
   Dispose();
+  
+  if (m_fLauncher)
+    Launcher::Retire(m_user);
+  
+  Cgroup::Remove(m_cgName + "/jobs");
+  Cgroup::Remove(m_cgName);
+  
+  // the log remains until output of running jobs ends
+  if (m_pLog != NULL)
+    m_pLog->Release();
+  
+  // running jobs are left alone, queued ones are dropped
+  PROC_MAP::iterator it = s_procMap.begin();
+  while (it != s_procMap.end()) {
+    if ((*it).second.pTab == this)
+      (*it).second.pTab = NULL;
+    it++;
+  }
+  
+  if (m_uQueued > 0) {
+    syslog(LOG_WARNING, "(%s%s) dropping %u queued jobs", m_fSysTable ? "system::" : "", m_user.c_str(), m_uQueued);
+    
+    JOB_QUEUE::iterator it2 = s_jobQueue.begin();
+    while (it2 != s_jobQueue.end()) {
+      if ((*it2).pTab == this) {
+        if ((*it2).pState->rate.pDelayed == &(*it2).argv)
+          (*it2).pState->rate.pDelayed = NULL;
+        release_state((*it2).pState);
+        it2 = s_jobQueue.erase(it2);
+        s_uQueued--;
+      }
+      else {
+        it2++;
+      }
+    }
+  }
 }
 
 void UserTable::Load()
@@ -269,6 +756,127 @@ void UserTable::Load()
 
   int cnt = m_tab.GetCount();
   
+  // jobs without own limits share the table's leaf group
+  if (Cgroup::IsEnabled()) {
+    CgroupLimits_t lim;
+    Cgroup::InitLimits(lim);
+    IncronCfg::GetValue("cgroup_cpu_max", lim.cpuMax);
+    IncronCfg::GetValue("cgroup_memory_max", lim.memMax);
+    IncronCfg::GetValue("cgroup_io_weight", lim.ioWeight);
+    
+    if (Cgroup::Create(m_cgName, lim, false) == 0) {
+      Cgroup::InitLimits(lim);
+      m_cgFd = Cgroup::Create(m_cgName + "/jobs", lim, true);
+    }
+  }
+  
+  // states of unchanged entries are carried over (when reloading)
+  std::vector<EntryState_t*> old;
+  old.swap(m_states);
+  
+  // one runtime state per rule, subdirectory entries share it
+  std::vector<EntryState_t*> states;
+  for (int i=0; i<cnt; i++) {
+    IncronTabEntry& rE = m_tab.GetEntry(i);
+    std::string ident = entry_ident(rE);
+    EntryState_t* pState = NULL;
+    for (size_t j=0; j<old.size() && pState == NULL; j++) {
+      if (old[j] != NULL && old[j]->ident == ident) {
+        pState = old[j];
+        old[j] = NULL;
+      }
+    }
+    if (pState == NULL) {
+      pState = new_state(this);
+      pState->ident = ident;
+    }
+    
+    init_cmd(pState->cmd, rE);
+    const char* pszBad = init_limits(pState->limits, rE);
+    if (pszBad != NULL)
+      syslog(LOG_WARNING, "(%s%s) invalid %s for %s, inherited", m_fSysTable ? "system::" : "", m_user.c_str(), pszBad, rE.GetPath().c_str());
+    init_batch(pState->batch, rE);
+    CoprocState_t prevCoproc = pState->coproc;
+    init_coproc(pState->coproc, rE);
+    init_key(pState->key, rE);
+    init_rate(pState->rate, rE);
+    
+    if (m_cgFd != -1 && rE.HasLimits()) {
+      CgroupLimits_t lim;
+      lim.cpuMax = rE.GetCpuMax();
+      lim.memMax = rE.GetMemoryMax();
+      lim.ioWeight = rE.GetIoWeight();
+      pState->limits.cgFd = Cgroup::Create(GetEntryCgroup(i), lim, true);
+    }
+    
+    std::string plugPath, plugArg;
+    if (Plugin::Parse(rE.GetCmd(), plugPath, plugArg)) {
+      if (m_fSysTable) {
+        // a carried over plugin stays loaded (with its context)
+        pState->plugin.fInProcess = true;
+        if (pState->plugin.pPlugin == NULL)
+          pState->plugin.pPlugin = Plugin::Load(plugPath, plugArg);
+      }
+      else {
+        // the plugin host runs with the user's credentials
+        pState->cmd.fDirect = true;
+        pState->cmd.words.clear();
+        add_literal(pState->cmd.words, "/proc/self/exe");
+        add_literal(pState->cmd.words, PLUGIN_HOST_OPTION);
+        add_literal(pState->cmd.words, plugPath);
+        if (!plugArg.empty())
+          add_literal(pState->cmd.words, plugArg);
+        pState->coproc.mode = CP_TSV;
+        pState->coproc.fAck = true;
+      }
+      pState->batch.time = 0;
+    }
+    
+    if (!pState->plugin.fInProcess && pState->cmd.fDirect && pState->cmd.words[0][0].text[0] == '@') {
+      pState->cmd.fileOp = FileAction::GetOp(pState->cmd.words[0][0].text);
+      if (pState->cmd.fileOp == FO_NONE)
+        syslog(LOG_WARNING, "(%s%s) unknown built-in action %s", m_fSysTable ? "system::" : "", m_user.c_str(), pState->cmd.words[0][0].text.c_str());
+      else if (pState->cmd.words.size() != FileAction::GetArgCount(pState->cmd.fileOp) + 1)
+        syslog(LOG_WARNING, "(%s%s) wrong count of arguments for %s", m_fSysTable ? "system::" : "", m_user.c_str(), pState->cmd.words[0][0].text.c_str());
+      
+      // built-in actions run one by one for each event
+      pState->coproc.mode = CP_NONE;
+      pState->batch.time = 0;
+    }
+    
+    // a coprocess is started once and a batch gets the names of all its events,
+    // so their commands cannot depend on single events
+    if ((pState->coproc.mode != CP_NONE || pState->batch.time > 0) && has_wildcards(pState->cmd)) {
+      syslog(LOG_ERR, "(%s%s) wildcards not allowed in %s command for %s, entry ignored", m_fSysTable ? "system::" : "", m_user.c_str(),
+          pState->coproc.mode != CP_NONE ? "coprocess" : "batched", rE.GetPath().c_str());
+      pState->cmd.fDisabled = true;
+    }
+    
+    // a running coprocess is kept (with its undelivered events) if unchanged
+    if (pState->coproc.pCoproc != NULL) {
+      if (pState->cmd.fDisabled || pState->coproc.mode != prevCoproc.mode || pState->coproc.fAck != prevCoproc.fAck) {
+        delete pState->coproc.pCoproc;
+        pState->coproc.pCoproc = NULL;
+      }
+      else {
+        pState->coproc.pCoproc->SetLimits(GetCgroupFd(pState), pState->limits.fSched ? &pState->limits.sched : NULL);
+      }
+    }
+    
+    // batching may have been turned off meanwhile
+    if (pState->batch.time == 0 && !pState->batch.names.empty())
+      FlushBatch(pState);
+    
+    states.push_back(pState);
+    m_states.push_back(pState);
+  }
+  
+  // states of removed (or changed) entries
+  for (size_t j=0; j<old.size(); j++) {
+    if (old[j] != NULL)
+      RetireState(old[j]);
+  }
+  
   // add all subdirectories (recursively) as new tab entries with same events
   for (int i=0; i<cnt; i++) {
     IncronTabEntry& rE = m_tab.GetEntry(i);
@@ -298,8 +906,10 @@ void UserTable::Load()
 	  if (rE.GetPath() == subDir )
 		continue;
 		
-	  IncronTabEntry ite = IncronTabEntry(subDir, rE.GetMask(), rE.GetCmd());
+	  IncronTabEntry ite(rE);
+	  ite.SetPath(subDir);
 	  m_tab.Add(ite);
+	  states.push_back(states[i]);
     }
   }
   
@@ -310,16 +920,19 @@ void UserTable::Load()
     // skip the wildcard selector, as they have been replace by the actual files
 	if (rE.GetPath().find("*") != std::string::npos) 
 		continue;
-	AddTabEntry(rE);
+    if (states[i]->cmd.fDisabled)
+      continue;
+	AddTabEntry(rE, states[i]);
   }
   
   m_pEd->Register(this);
 }
 
-void UserTable::AddTabEntry(IncronTabEntry& rE)
+void UserTable::AddTabEntry(IncronTabEntry& rE, EntryState_t* pState)
 {
     //syslog(LOG_INFO, "registering inotify for (%s)", rE.GetPath().c_str()); // TODO is this log spamming too much ?
     InotifyWatch* pW = new InotifyWatch(rE.GetPath(), rE.GetMask());
+    pW->SetPriority(rE.IsPriority());
 
     // warning only - permissions may change later
     if (!(m_fSysTable || MayAccess(rE.GetPath(), DONT_FOLLOW(rE.GetMask()))))
@@ -327,7 +940,14 @@ void UserTable::AddTabEntry(IncronTabEntry& rE)
 
     try {
       m_in.Add(pW);
-      m_map.insert(IWCE_MAP::value_type(pW, &rE));
+      WatchEntry_t we;
+      we.pEntry = &rE;
+      we.pState = pState;
+      we.access[0].fKnown = false;
+      we.access[1].fKnown = false;
+      we.inFlight = 0;
+      we.quietUntil = 0;
+      m_map.insert(IWCE_MAP::value_type(pW, we));
     } catch (InotifyException e) {
       if (m_fSysTable)
         syslog(LOG_ERR, "cannot create watch for system table %s: (%i) %s", m_user.c_str(), e.GetErrorNumber(), strerror(e.GetErrorNumber()));
@@ -339,6 +959,24 @@ void UserTable::AddTabEntry(IncronTabEntry& rE)
 
 
 void UserTable::Dispose()
+{
+  RemoveWatches();
+  CloseCgroups();
+  
+  for (size_t i=0; i<m_states.size(); i++) {
+    RetireState(m_states[i]);
+  }
+  m_states.clear();
+}
+
+void UserTable::Reload()
+{
+  RemoveWatches();
+  CloseCgroups();
+  Load();
+}
+
+void UserTable::RemoveWatches()
 {
   m_pEd->Unregister(this);
 
@@ -347,15 +985,31 @@ void UserTable::Dispose()
     InotifyWatch* pW = (*it).first;
     m_in.Remove(pW);
 
-    PROC_MAP::iterator it2 = s_procMap.begin();
-    while (it2 != s_procMap.end()) {
-      if ((*it2).second.pWatch == pW) {
-        PROC_MAP::iterator it3 = it2;
-        it2++;
-        s_procMap.erase(it3);
-      }
-      else {
-        it2++;
+    // jobs remain (they are needed for limits) but forget the watch
+    std::pair<WATCHPROC_MAP::iterator, WATCHPROC_MAP::iterator> range = s_watchProcs.equal_range(pW);
+    for (WATCHPROC_MAP::iterator it2 = range.first; it2 != range.second; it2++) {
+      PROC_MAP::iterator itP = s_procMap.find((*it2).second);
+      if (itP != s_procMap.end())
+        (*itP).second.pWatch = NULL;
+    }
+    s_watchProcs.erase(range.first, range.second);
+    
+    JOB_QUEUE::iterator it3 = s_jobQueue.begin();
+    while (it3 != s_jobQueue.end()) {
+      if ((*it3).pWatch == pW)
+        (*it3).pWatch = NULL;
+      it3++;
+    }
+    
+    // jobs waiting for their keys
+    for (size_t i=0; i<m_states.size(); i++) {
+      KEYSLOT_MAP& rSlots = m_states[i]->key.slots;
+      for (KEYSLOT_MAP::iterator it4 = rSlots.begin(); it4 != rSlots.end(); it4++) {
+        std::deque<Job_t>& rW = (*it4).second.waiting;
+        for (size_t j=0; j<rW.size(); j++) {
+          if (rW[j].pWatch == pW)
+            rW[j].pWatch = NULL;
+        }
       }
     }
 
@@ -366,159 +1020,985 @@ void UserTable::Dispose()
   m_map.clear();
 }
 
-void UserTable::OnEvent(InotifyEvent& rEvt)
+void UserTable::CloseCgroups()
 {
-  InotifyWatch* pW = rEvt.GetWatch();
-  IncronTabEntry* pE = FindEntry(pW);
-
-  // no entry found - this shouldn't occur
-  if (pE == NULL)
-    return;
-
-  // discard event if user has no access rights to watch path
-  if (!(m_fSysTable || MayAccess(pW->GetPath(), DONT_FOLLOW(rEvt.GetMask()))))
-    return;
-    
-  //#if 0
-  // log output for each dir + file + event
-  std::string events;
-  rEvt.DumpTypes(events);
-  syslog(LOG_INFO, "PATH (%s) FILE (%s) EVENT (%s)", pW->GetPath().c_str() , IncronTabEntry::GetSafePath(rEvt.GetName()).c_str() , events.c_str());
-  //#endif
+  // the groups remain if jobs still run there
+  for (size_t i=0; i<m_states.size(); i++) {
+    if (m_states[i]->limits.cgFd != -1) {
+      close(m_states[i]->limits.cgFd);
+      m_states[i]->limits.cgFd = -1;
+      Cgroup::Remove(GetEntryCgroup(i));
+    }
+  }
   
-  // add new watch for newly created subdirs
-  if ( rEvt.IsType(IN_ISDIR) && (rEvt.IsType(IN_CREATE) || rEvt.IsType(IN_MOVED_TO)) )
-  {
-	Dispose();
-	sleep (1);
-	Load();
-  // this is the fast way of registering new subsirs, but it 
-  // misses new sub-sub dirs if they are created too fast in a row
-  // eg by : mkdir -p /tmp/a/b/c/d/e
-  // so the reload is for now the better way to go
-  // the complete reload also happens if the incrontab file changes
-  /*
-  m_pEd->Unregister(this);
-	std::string * pECmd = new std::string(pE->GetCmd().c_str());
-	IncronTabEntry * newEntry = new IncronTabEntry(completeFile, pE->GetMask(),  *pECmd);
-	m_tab.Add(*newEntry);
-	AddTabEntry(*newEntry);
-  m_pEd->Register(this);
-  */ 
+  if (m_cgFd != -1) {
+    close(m_cgFd);
+    m_cgFd = -1;
   }
+}
 
-  std::string cmd;
-  const std::string& cs = pE->GetCmd();
-  size_t pos = 0;
-  size_t oldpos = 0;
-  size_t len = cs.length();
-  while ((pos = cs.find('$', oldpos)) != std::string::npos) {
-    if (pos < len - 1) {
-      size_t px = pos + 1;
-      if (cs[px] == '$') {
-        cmd.append(cs.substr(oldpos, pos-oldpos+1));
-        oldpos = pos + 2;
-      }
-      else {
-        cmd.append(cs.substr(oldpos, pos-oldpos));
-        if (cs[px] == '@') {          // base path
-          cmd.append(IncronTabEntry::GetSafePath(pW->GetPath()));
-          oldpos = pos + 2;
-        }
-        else if (cs[px] == '#') {     // file name
-          cmd.append(IncronTabEntry::GetSafePath(rEvt.GetName()));
-          oldpos = pos + 2;
-        }
-        else if (cs[px] == '%') {     // mask symbols
-          std::string s;
-          rEvt.DumpTypes(s);
-          cmd.append(s);
-          oldpos = pos + 2;
-        }
-        else if (cs[px] == '&') {     // numeric mask
-          char* s;
-#pragma GCC diagnostic ignored "-Wunused-result"  
-          asprintf(&s, "%u", (unsigned) rEvt.GetMask());
-#pragma GCC diagnostic warning "-Wunused-result"
-          cmd.append(s);
-          free(s);
-          oldpos = pos + 2;
-        }
-        else {
-          oldpos = pos + 1;
-        }
-      }
-    }
-    else {
-      cmd.append(cs.substr(oldpos, pos-oldpos));
-      oldpos = pos + 1;
+void UserTable::RetireState(EntryState_t* pState)
+{
+  // a pending batch is run now
+  if (!pState->batch.names.empty())
+    FlushBatch(pState);
+  
+  delete pState->coproc.pCoproc;
+  pState->coproc.pCoproc = NULL;
+  delete pState->plugin.pPlugin;
+  pState->plugin.pPlugin = NULL;
+  
+  release_state(pState);
+}
+
+/// Returns the current time of a clock.
+/**
+ * \param[in] clk clock identifier
+ * \return time in microseconds
+ */
+static uint64_t get_usec(clockid_t clk)
+{
+  struct timespec ts;
+  clock_gettime(clk, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000000 + ((uint64_t) ts.tv_nsec) / 1000;
+}
+
+void UserTable::OnEvent(InotifyEvent& rEvt)
+{
+  uint64_t t0 = get_usec(CLOCK_MONOTONIC);
+  uint64_t c0 = get_usec(CLOCK_THREAD_CPUTIME_ID);
+  
+  if (rEvt.GetTime() != 0 && rEvt.GetTime() < t0) {
+    uint64_t delay = t0 - rEvt.GetTime();
+    m_stats.delay += delay;
+    if (delay > m_stats.maxDelay)
+      m_stats.maxDelay = delay;
+  }
+  
+  ProcessEvent(rEvt);
+  
+  m_stats.events++;
+  m_stats.cpu += get_usec(CLOCK_THREAD_CPUTIME_ID) - c0;
+  m_stats.busy += get_usec(CLOCK_MONOTONIC) - t0;
+}
+
+void UserTable::DumpStats() const
+{
+  unsigned long long avg = m_stats.events > 0 ? m_stats.delay / m_stats.events : 0;
+  
+  syslog(LOG_NOTICE, "(%s%s) STATS events %llu, lost %llu, suppressed %llu, collapsed %llu, throttled %llu, busy %llu ms, cpu %llu ms, delay avg %llu us, max %llu us, jobs running %u, queued %u, timed out %llu, killed %llu",
+      m_fSysTable ? "system::" : "", m_user.c_str(),
+      (unsigned long long) m_stats.events,
+      (unsigned long long) m_in.GetLostCount(),
+      (unsigned long long) m_stats.suppressed,
+      (unsigned long long) m_stats.collapsed,
+      (unsigned long long) m_stats.throttled,
+      (unsigned long long) m_stats.busy / 1000,
+      (unsigned long long) m_stats.cpu / 1000,
+      avg,
+      (unsigned long long) m_stats.maxDelay,
+      m_uRunning,
+      m_uQueued,
+      (unsigned long long) m_stats.timeouts,
+      (unsigned long long) m_stats.kills);
+  
+  DumpUsage("jobs", m_stats.usage);
+  
+  // entries of the current table version only
+  for (size_t i=0; i<m_states.size(); i++) {
+    if (m_states[i]->usage.jobs > 0)
+      DumpUsage(m_tab.GetEntry(i).GetPath().c_str(), m_states[i]->usage);
+  }
+}
+
+void UserTable::DumpUsage(const char* pszWhat, const JobUsage_t& rU) const
+{
+  syslog(LOG_NOTICE, "(%s%s) STATS %s: finished %llu, failed %llu, wall %llu ms, user %llu ms, sys %llu ms, max rss %llu KB, blocks in %llu, out %llu",
+      m_fSysTable ? "system::" : "", m_user.c_str(), pszWhat,
+      (unsigned long long) rU.jobs,
+      (unsigned long long) rU.failed,
+      (unsigned long long) rU.wall,
+      (unsigned long long) rU.user / 1000,
+      (unsigned long long) rU.sys / 1000,
+      (unsigned long long) rU.maxRss,
+      (unsigned long long) rU.inBlock,
+      (unsigned long long) rU.outBlock);
+}
+
+void UserTable::ProcessEvent(InotifyEvent& rEvt)
+{
+  InotifyWatch* pW = rEvt.GetWatch();
+  WatchEntry_t* pWE = FindEntry(pW);
+
+  // no entry found - this shouldn't occur
+  if (pWE == NULL)
+    return;
+  
+  IncronTabEntry* pE = pWE->pEntry;
+
+  // permissions (or the file itself) may have changed
+  if (rEvt.GetName().empty() && (rEvt.IsType(IN_ATTRIB) || rEvt.IsType(IN_MOVE_SELF) || rEvt.IsType(IN_DELETE_SELF))) {
+    pWE->access[0].fKnown = false;
+    pWE->access[1].fKnown = false;
+  }
+  
+  // discard event if user has no access rights to watch path
+  if (!(m_fSysTable || MayAccessCached(pWE, pW->GetPath(), DONT_FOLLOW(rEvt.GetMask()))))
+    return;
+  
+  // events are suppressed while (and shortly after) the watch's jobs run
+  // - the watch remains active, so events for other entries are not lost
+  if (pE->IsNoLoop() && (pWE->inFlight > 0 || (pWE->quietUntil > 0 && get_usec(CLOCK_MONOTONIC) / 1000 < pWE->quietUntil))) {
+    m_stats.suppressed++;
+    return;
+  }
+    
+  //#if 0
+  // log output for each dir + file + event
+  std::string events;
+  rEvt.DumpTypes(events);
+  syslog(LOG_INFO, "PATH (%s) FILE (%s) EVENT (%s)", pW->GetPath().c_str() , IncronTabEntry::GetSafePath(rEvt.GetName()).c_str() , events.c_str());
+  //#endif
+  
+  // add new watch for newly created subdirs
+  if ( rEvt.IsType(IN_ISDIR) && (rEvt.IsType(IN_CREATE) || rEvt.IsType(IN_MOVED_TO)) )
+  {
+    // the table is reloaded with a delay (once for a burst of new subdirs)
+    // to catch also sub-sub dirs created too fast in a row
+    // eg by : mkdir -p /tmp/a/b/c/d/e
+    // the complete reload also happens if the incrontab file changes
+    if (m_reloadTimer == 0)
+      m_reloadTimer = m_pEd->GetTimers()->Schedule(RELOAD_DELAY, OnReloadTimer, this);
+  }
+
+  Job_t job;
+  job.pTab = this;
+  job.pState = pWE->pState;
+  job.pWatch = pW;
+  job.fNoLoop = false;
+  job.fKeyed = false;
+  job.notBefore = 0;
+  
+  // an in-process plugin gets the event directly
+  if (job.pState->plugin.fInProcess) {
+    if (job.pState->plugin.pPlugin != NULL)
+      job.pState->plugin.pPlugin->Handle(pW->GetPath(), rEvt.GetName(), rEvt.GetMask());
+    return;
+  }
+  
+  // a coprocess gets the event without expanding the command
+  if (job.pState->coproc.pCoproc != NULL) {
+    job.pState->coproc.pCoproc->Post(rEvt, pW->GetPath());
+    return;
+  }
+  
+  // commands are expanded from their compiled templates
+  std::string& cmd = s_cmdBuf;
+  cmd.clear();
+  if (job.pState->cmd.fDirect) {
+    std::vector<CMD_WORD>& rWords = job.pState->cmd.words;
+    for (size_t i=0; i<rWords.size(); i++) {
+      size_t mark = cmd.length();
+      if (mark > 0)
+        cmd.push_back(' ');
+      size_t start = cmd.length();
+      ExpandWord(rWords[i], false, rEvt, pW->GetPath(), cmd);
+      
+      // empty words disappear (like in the shell)
+      if (cmd.length() > start)
+        job.argv.push_back(cmd.substr(start));
+      else
+        cmd.resize(mark);
     }
   }
-  cmd.append(cs.substr(oldpos));
+  else {
+    ExpandWord(job.pState->cmd.shellCmd, true, rEvt, pW->GetPath(), cmd);
+    
+    job.argv.push_back(m_fSysTable ? SYS_SHELL : USER_SHELL);
+    job.argv.push_back("-c");
+    job.argv.push_back(cmd);
+  }
 
   if (m_fSysTable)
     syslog(LOG_INFO, "(system::%s) CMD (%s)", m_user.c_str(), cmd.c_str());
   else
     syslog(LOG_INFO, "(%s) CMD (%s)", m_user.c_str(), cmd.c_str());
+  
+  // arguments may disappear when expanded (e.g. an empty file name)
+  if (job.pState->cmd.fileOp != FO_NONE && job.argv.size() != FileAction::GetArgCount(job.pState->cmd.fileOp) + 1) {
+    syslog(LOG_ERR, "cannot perform %s: wrong count of arguments", job.argv[0].c_str());
+    return;
+  }
+
+  job.input.clear();
+  job.fManifest = false;
+  
+  EntryState_t* pState = job.pState;
+  if (pState->coproc.mode != CP_NONE) {
+    std::string logId = m_fSysTable ? "(system::" + m_user + ")" : "(" + m_user + ")";
+    pState->coproc.pCoproc = new Coprocess(m_pEd, this, job.argv, pState->coproc.mode, pState->coproc.fAck, logId, GetCgroupFd(pState),
+        pState->limits.fSched ? &pState->limits.sched : NULL);
+    pState->coproc.pCoproc->Post(rEvt, pW->GetPath());
+    return;
+  }
+  
+  if (pState->batch.time > 0) {
+    // the first event of a batch determines the command
+    if (pState->batch.names.empty()) {
+      pState->batch.argv.swap(job.argv);
+      pState->batch.timer = m_pEd->GetTimers()->Schedule(pState->batch.time, OnBatchTimer, pState);
+    }
     
-#ifdef LOOPER
-  if (pE->IsNoLoop())
-    pW->SetEnabled(false);
-#endif
+    pState->batch.names.push_back(rEvt.GetName().empty()
+        ? pW->GetPath()
+        : IncronCfg::BuildPath(pW->GetPath(), rEvt.GetName()));
+    
+    if (pState->batch.size > 0 && pState->batch.names.size() >= pState->batch.size)
+      FlushBatch(pState);
+    
+    return;
+  }
+  
+  // jobs held by their keys are in flight too
+  if (pE->IsNoLoop()) {
+    job.fNoLoop = true;
+    pWE->inFlight++;
+  }
+  
+  // the key is expanded for this event
+  if (pState->key.mode != KM_NONE) {
+    job.key.clear();
+    ExpandWord(pState->key.templ, false, rEvt, pW->GetPath(), job.key);
+    if (HoldByKey(job))
+      return;
+  }
+  
+  if (!Submit(job, pE->IsPriority()))
+    DropJob(job);
+}
+
+bool UserTable::Submit(Job_t& rJob, bool fPriority)
+{
+  if ((rJob.pState->rate.bucket.rate > 0 || m_bucket.rate > 0) && !Throttle(rJob))
+    return false;
+  
+  rJob.pState->refs++;
+  
+  // all queued jobs are blocked by limits, so this one may overtake them
+  if (rJob.notBefore == 0 && MayStart(rJob.pState)) {
+    StartJob(rJob);
+  }
+  else {
+    // high priority jobs go behind the queued high priority ones
+    JOB_QUEUE::iterator pos = s_jobQueue.end();
+    if (fPriority) {
+      pos = s_jobQueue.begin();
+      while (pos != s_jobQueue.end() && (*pos).pState->limits.fPriority) {
+        pos++;
+      }
+    }
+    pos = s_jobQueue.insert(pos, rJob);
+    
+    if (rJob.notBefore != 0 && rJob.pState->rate.policy == RP_COALESCE)
+      rJob.pState->rate.pDelayed = &(*pos).argv;
+    
+    s_uQueued++;
+    m_uQueued++;
+  }
+  
+  return true;
+}
+
+bool UserTable::Throttle(Job_t& rJob)
+{
+  EntryState_t* pState = rJob.pState;
+  uint64_t now = get_usec(CLOCK_MONOTONIC) / 1000;
+  
+  TokenBucket_t* buckets[2] = { NULL, NULL };
+  if (pState->rate.bucket.rate > 0)
+    buckets[0] = &pState->rate.bucket;
+  if (m_bucket.rate > 0)
+    buckets[1] = &m_bucket;
+  
+  bool ok = true;
+  for (int i=0; i<2; i++) {
+    if (buckets[i] != NULL) {
+      refill_bucket(*buckets[i], now);
+      if (buckets[i]->tokens < 1)
+        ok = false;
+    }
+  }
+  
+  if (ok) {
+    for (int i=0; i<2; i++) {
+      if (buckets[i] != NULL)
+        buckets[i]->tokens -= 1;
+    }
+    return true;
+  }
+  
+  m_stats.throttled++;
+  
+  if (pState->rate.policy == RP_DROP)
+    return false;
+  
+  // jobs with keys or batches cannot be merged (they differ in more than arguments)
+  if (pState->rate.policy == RP_COALESCE && pState->rate.pDelayed != NULL && pState->key.mode == KM_NONE && pState->batch.time == 0) {
+    pState->rate.pDelayed->swap(rJob.argv);
+    return false;
+  }
+  
+  // a token is reserved, the job waits until it would be available
+  uint64_t wait = 0;
+  for (int i=0; i<2; i++) {
+    if (buckets[i] != NULL) {
+      buckets[i]->tokens -= 1;
+      if (buckets[i]->tokens < 0) {
+        uint64_t w = (uint64_t) (-buckets[i]->tokens * 1000 / buckets[i]->rate) + 1;
+        if (w > wait)
+          wait = w;
+      }
+    }
+  }
+  
+  rJob.notBefore = now + wait;
+  m_pEd->GetTimers()->Schedule(wait, OnRateTimer, NULL);
+  return true;
+}
+
+void UserTable::DropJob(const Job_t& rJob)
+{
+  if (rJob.fNoLoop && rJob.pWatch != NULL)
+    LeaveFlight(rJob.pWatch);
+  if (rJob.fKeyed)
+    ReleaseKey(rJob.pState, rJob.key, this);
+}
 
-  pid_t pid = fork();
-  if (pid == 0) {
+void UserTable::OnRateTimer(void*)
+{
+  StartJobs();
+}
 
-    // for system table
-    if (m_fSysTable) {
-      if (system(cmd.c_str()) != 0) // exec failed
-      {
-        syslog(LOG_ERR, "cannot exec process: %s", strerror(errno));
-        _exit(1);
+bool UserTable::HoldByKey(Job_t& rJob)
+{
+  KEYSLOT_MAP::iterator it = rJob.pState->key.slots.find(rJob.key);
+  if (it == rJob.pState->key.slots.end()) {
+    KeySlot_t slot;
+    slot.fStarted = false;
+    rJob.pState->key.slots.insert(KEYSLOT_MAP::value_type(rJob.key, slot));
+    rJob.fKeyed = true;
+    return false;
+  }
+  
+  KeySlot_t& rSlot = (*it).second;
+  if (rJob.pState->key.mode == KM_COLLAPSE) {
+    // the queued job takes over the newer arguments
+    if (!rSlot.fStarted) {
+      m_stats.collapsed++;
+      for (JOB_QUEUE::iterator it2 = s_jobQueue.begin(); it2 != s_jobQueue.end(); it2++) {
+        if ((*it2).pState == rJob.pState && (*it2).fKeyed && (*it2).key == rJob.key) {
+          (*it2).argv.swap(rJob.argv);
+          break;
+        }
       }
+      if (rJob.fNoLoop && rJob.pWatch != NULL)
+        LeaveFlight(rJob.pWatch);
+      return true;
+    }
+    
+    // the waiting job is replaced by the newer one
+    if (!rSlot.waiting.empty()) {
+      m_stats.collapsed++;
+      Job_t& rOld = rSlot.waiting.back();
+      if (rOld.fNoLoop && rOld.pWatch != NULL)
+        LeaveFlight(rOld.pWatch);
+      rOld = rJob;
+      return true;
+    }
+  }
+  
+  rSlot.waiting.push_back(rJob);
+  return true;
+}
+
+void UserTable::ReleaseKey(EntryState_t* pState, const std::string& rKey, UserTable* pTab)
+{
+  KEYSLOT_MAP::iterator it = pState->key.slots.find(rKey);
+  if (it == pState->key.slots.end())
+    return;
+  
+  KeySlot_t& rSlot = (*it).second;
+  rSlot.fStarted = false;
+  
+  // the next waiting job becomes the active one (unless dropped by rate limits)
+  while (pTab != NULL && !rSlot.waiting.empty()) {
+    Job_t job = rSlot.waiting.front();
+    job.fKeyed = true;
+    rSlot.waiting.pop_front();
+    
+    if (pTab->Submit(job, pState->limits.fPriority))
+      return;
+    
+    if (job.fNoLoop && job.pWatch != NULL)
+      pTab->LeaveFlight(job.pWatch);
+  }
+  
+  pState->key.slots.erase(it);
+}
+
+void UserTable::FlushBatch(EntryState_t* pState)
+{
+  m_pEd->GetTimers()->Cancel(pState->batch.timer);
+  pState->batch.timer = 0;
+  
+  Job_t job;
+  job.pTab = this;
+  job.pState = pState;
+  job.pWatch = NULL;
+  job.fNoLoop = false;
+  job.fManifest = false;
+  job.fKeyed = false;
+  job.notBefore = 0;
+  job.argv.swap(pState->batch.argv);
+  
+  std::vector<std::string>& rNames = pState->batch.names;
+  
+  // names are appended to the command or passed as a list
+  bool fShell = !pState->cmd.fDirect;
+  switch (pState->batch.mode) {
+    case BM_ARGV:
+      for (size_t i=0; i<rNames.size(); i++) {
+        if (fShell) {
+          job.argv.back().append(" ");
+          job.argv.back().append(IncronTabEntry::GetSafePath(rNames[i]));
+        }
+        else {
+          job.argv.push_back(rNames[i]);
+        }
+      }
+      break;
+    case BM_STDIN:
+      for (size_t i=0; i<rNames.size(); i++) {
+        job.input.append(rNames[i]);
+        job.input.push_back('\0');
+      }
+      break;
+    case BM_MANIFEST:
+      for (size_t i=0; i<rNames.size(); i++) {
+        job.input.append(rNames[i]);
+        job.input.push_back('\n');
+      }
+      job.fManifest = true;
+      break;
+  }
+  
+  syslog(LOG_INFO, "(%s%s) BATCH (%u events)", m_fSysTable ? "system::" : "", m_user.c_str(), (unsigned) rNames.size());
+  
+  rNames.clear();
+  Submit(job, pState->limits.fPriority);
+}
+
+void UserTable::OnBatchTimer(void* pArg)
+{
+  EntryState_t* pState = (EntryState_t*) pArg;
+  pState->batch.timer = 0;
+  pState->pTab->FlushBatch(pState);
+}
+
+/// Creates an unnamed file with the given content.
+/**
+ * \param[in] rData file content
+ * \return descriptor (positioned at the beginning); -1 on error
+ */
+static int make_input(const std::string& rData)
+{
+  int fd = -1;
+#ifdef SYS_memfd_create
+  fd = (int) syscall(SYS_memfd_create, "incron", 1U); // MFD_CLOEXEC
+#endif // SYS_memfd_create
+  
+  if (fd == -1) {
+    char path[] = "/tmp/incron.XXXXXX";
+    fd = mkstemp(path);
+    if (fd == -1)
+      return -1;
+    unlink(path);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+  
+  size_t done = 0;
+  while (done < rData.length()) {
+    ssize_t n = write(fd, rData.data() + done, rData.length() - done);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      int err = errno;
+      close(fd);
+      errno = err;
+      return -1;
+    }
+    done += n;
+  }
+  
+  lseek(fd, 0, SEEK_SET);
+  return fd;
+}
+
+bool UserTable::MayStart(const EntryState_t* pState) const
+{
+  return (s_uMaxJobs == 0 || s_procMap.size() < s_uMaxJobs)
+      && (m_uMaxJobs == 0 || m_uRunning < m_uMaxJobs)
+      && (pState->limits.maxJobs == 0 || pState->limits.running < pState->limits.maxJobs);
+}
+
+void UserTable::StartJob(const Job_t& rJob)
+{
+  if (rJob.pState->cmd.fileOp != FO_NONE) {
+    StartAction(rJob);
+    return;
+  }
+  
+  pid_t pid = 0;
+  std::string manifest;
+  const ARGV* pArgv = &rJob.argv;
+  ARGV argv;
+  int fds[3] = { -1, -1, -1 };
+  int out[2] = { -1, -1 };
+  bool ok = true;
+  
+  if (rJob.fManifest) {
+    std::string dir;
+    IncronCfg::GetValue("batch_manifest_dir", dir);
+    manifest = IncronCfg::BuildPath(dir, "incron.XXXXXX");
+    
+    int fd = mkstemp(&manifest[0]);
+    ok = fd != -1;
+    if (ok) {
+      // the manifest is readable for the user
+      const UserCred_t* pCred = m_fSysTable ? NULL : CredCache::Get(m_user);
+      ok = pCred == NULL || (pCred->fValid && fchown(fd, pCred->uid, pCred->gid) == 0);
+      
+      size_t done = 0;
+      while (ok && done < rJob.input.length()) {
+        ssize_t n = write(fd, rJob.input.data() + done, rJob.input.length() - done);
+        if (n == -1 && errno != EINTR)
+          ok = false;
+        else if (n > 0)
+          done += n;
+      }
+      close(fd);
+      
+      argv = rJob.argv;
+      if (rJob.pState->cmd.fDirect)
+        argv.push_back(manifest);
+      else
+        argv.back().append(" " + IncronTabEntry::GetSafePath(manifest));
+      pArgv = &argv;
     }
     else {
-      // for user table
-      RunAsUser(cmd);
-#ifdef LOOPER
-	  if (pE->IsNoLoop())
-		pW->SetEnabled(true);
-#endif
+      manifest.clear();
     }
   }
-  else if (pid > 0) {
-#ifdef LOOPER
-    ProcData_t pd;
-    if (pE->IsNoLoop()) {
-      pd.onDone = on_proc_done;
-      pd.pWatch = pW;
+  else if (!rJob.input.empty()) {
+    fds[0] = make_input(rJob.input);
+    ok = fds[0] != -1;
+  }
+  
+  // the output goes to the table's job log
+  if (ok && m_pLog != NULL) {
+    if (pipe2(out, O_CLOEXEC) == 0) {
+      fds[1] = out[1];
+      fds[2] = out[1];
     }
     else {
-      pd.onDone = NULL;
-      pd.pWatch = NULL;
+      syslog(LOG_WARNING, "cannot create output pipe: %s", strerror(errno));
+      out[0] = -1;
+      out[1] = -1;
+    }
+  }
+  
+  unsigned jobId = ++s_uJobId;
+  if (ok)
+    pid = Launch(-(pid_t) jobId, *pArgv, fds, GetCgroupFd(rJob.pState), rJob.pState->limits.fSched ? &rJob.pState->limits.sched : NULL);
+  
+  int err = errno;
+  if (fds[0] != -1)
+    close(fds[0]);
+  if (out[1] != -1)
+    close(out[1]);
+  if (pid == 0 && !manifest.empty())
+    unlink(manifest.c_str());
+  
+  if (pid != 0 && m_pLog != NULL) {
+    // shell commands are logged without the shell
+    std::string msg("started:");
+    for (size_t i = rJob.pState->cmd.fDirect ? 0 : 2; i<pArgv->size(); i++) {
+      msg.append(" ");
+      msg.append((*pArgv)[i]);
+    }
+    m_pLog->Write(jobId, pid, msg.data(), msg.length());
+  }
+  
+  if (out[0] != -1) {
+    if (pid != 0)
+      OutputCapture::Start(m_pEd, out[0], m_pLog, jobId, pid);
+    else
+      close(out[0]);
+  }
+  errno = err;
+  
+  if (pid != 0) {
+    TrackJob(rJob, pid, jobId, manifest);
+  }
+  else {
+    DropJob(rJob);
+    
+    syslog(LOG_ERR, "cannot exec process: %s", strerror(errno));
+    release_state(rJob.pState);
+  }
+}
+
+pid_t UserTable::Launch(pid_t id, const ARGV& rArgv, const int* fds, int iCgroupFd, const JobSched_t* pSched)
+{
+  Launcher* pL = m_fLauncher ? Launcher::Get(m_pEd, m_user) : NULL;
+  if (pL != NULL) {
+    std::vector<char*> argv;
+    for (size_t i=0; i<rArgv.size(); i++) {
+      argv.push_back((char*) rArgv[i].c_str());
     }
+    argv.push_back(NULL);
+    
+    if (pL->Spawn(id, &argv[0], fds, iCgroupFd, pSched))
+      return id;
+    
+    // start it directly if the launcher is gone
+    if (pL->IsAlive())
+      return 0;
+  }
+  
+  pid_t pid = RunAsUser(rArgv, fds, iCgroupFd, pSched);
+  return pid > 0 ? pid : 0;
+}
 
-    s_procMap.insert(PROC_MAP::value_type(pid, pd));
+void UserTable::StartAction(const Job_t& rJob)
+{
+  const UserCred_t* pCred = m_fSysTable ? NULL : CredCache::Get(m_user);
+  unsigned jobId = ++s_uJobId;
+  pid_t pid = -(pid_t) jobId;
+  
+  bool ok = pCred == NULL || pCred->fValid;
+  if (!ok)
+    errno = ENOENT;
+  else
+    ok = FileAction::Submit(pid, rJob.pState->cmd.fileOp, rJob.argv, pCred);
+  
+  if (ok) {
+    if (m_pLog != NULL) {
+      std::string msg("started:");
+      for (size_t i=0; i<rJob.argv.size(); i++) {
+        msg.append(" ");
+        msg.append(rJob.argv[i]);
+      }
+      m_pLog->Write(jobId, pid, msg.data(), msg.length());
+    }
+    TrackJob(rJob, pid, jobId, std::string());
+  }
+  else {
+    DropJob(rJob);
+    
+    syslog(LOG_ERR, "cannot perform %s: %s", rJob.argv[0].c_str(), strerror(errno));
+    release_state(rJob.pState);
+  }
+}
+
+void UserTable::TrackJob(const Job_t& rJob, pid_t pid, unsigned jobId, const std::string& rManifest)
+{
+  ProcData_t pd;
+  pd.pid = pid > 0 ? pid : 0;
+  pd.fNoLoop = rJob.fNoLoop;
+  pd.fKeyed = rJob.fKeyed;
+  if (rJob.fKeyed) {
+    pd.key = rJob.key;
+    rJob.pState->key.slots[rJob.key].fStarted = true;
+  }
+  pd.pWatch = rJob.pWatch;
+  pd.pTab = this;
+  pd.pState = rJob.pState;
+  pd.manifest = rManifest;
+  pd.jobId = jobId;
+  pd.pLog = m_pLog;
+  if (pd.pLog != NULL)
+    pd.pLog->AddRef();
+  pd.pEd = m_pEd;
+  pd.killTimer = 0;
+  pd.killStage = 0;
+  pd.pidfd = -1;
+  pd.started = get_usec(CLOCK_MONOTONIC) / 1000;
+  if (rJob.pState->limits.timeout > 0 && rJob.pState->cmd.fileOp == FO_NONE) {
+#ifdef SYS_pidfd_open
+    if (pid > 0)
+      pd.pidfd = (int) syscall(SYS_pidfd_open, pid, 0);
 #endif
+    pd.killTimer = m_pEd->GetTimers()->Schedule(rJob.pState->limits.timeout * 1000ULL, OnKillTimer, (void*) (intptr_t) pid);
+  }
+  s_procMap.insert(PROC_MAP::value_type(pid, pd));
+  if (rJob.pWatch != NULL)
+    s_watchProcs.insert(WATCHPROC_MAP::value_type(rJob.pWatch, pid));
+  m_uRunning++;
+  rJob.pState->limits.running++;
+}
+
+void UserTable::OnKillTimer(void* pArg)
+{
+  pid_t pid = (pid_t) (intptr_t) pArg;
+  PROC_MAP::iterator it = s_procMap.find(pid);
+  if (it == s_procMap.end())
+    return;
+  
+  ProcData_t& rPd = (*it).second;
+  rPd.killTimer = 0;
+  
+  // the launcher hasn't reported the process yet
+  if (rPd.pid == 0) {
+    rPd.killTimer = rPd.pEd->GetTimers()->Schedule(rPd.pState->limits.killAfter * 1000ULL, OnKillTimer, pArg);
+    return;
+  }
+  
+  if (rPd.killStage >= 2) {
+    // the process cannot be killed (e.g. uninterruptible sleep)
+    syslog(LOG_ERR, "job %i does not finish after SIGKILL, abandoning it", (int) rPd.pid);
+    FinishJob(pid, -1, NULL);
+    StartJobs();
+    return;
+  }
+  
+  int sig = rPd.killStage == 0 ? SIGTERM : SIGKILL;
+  if (rPd.killStage == 0) {
+    syslog(LOG_WARNING, "job %i exceeded its time limit (%u s), terminating it", (int) rPd.pid, rPd.pState->limits.timeout);
+    if (rPd.pTab != NULL)
+      rPd.pTab->m_stats.timeouts++;
   }
   else {
-#ifdef LOOPER
-    if (pE->IsNoLoop())
-      pW->SetEnabled(true);
+    syslog(LOG_WARNING, "job %i still runs, killing it", (int) rPd.pid);
+    if (rPd.pTab != NULL)
+      rPd.pTab->m_stats.kills++;
+  }
+  rPd.killStage++;
+  
+  // the PID must still be the job's: own children are not reaped yet,
+  // launcher jobs are checked by the descriptor (only for liveness,
+  // the signal goes to the whole process group the job leads)
+  bool alive = pid > 0;
+#ifdef SYS_pidfd_send_signal
+  if (rPd.pidfd != -1)
+    alive = syscall(SYS_pidfd_send_signal, rPd.pidfd, 0, NULL, 0) == 0 || errno != ESRCH;
 #endif
+  
+  if (alive)
+    killpg(rPd.pid, sig);
+  else if (rPd.pidfd == -1)
+    syslog(LOG_WARNING, "job %i cannot be signalled safely (no process descriptor)", (int) rPd.pid);
+  
+  rPd.killTimer = rPd.pEd->GetTimers()->Schedule(rPd.pState->limits.killAfter * 1000ULL, OnKillTimer, pArg);
+}
+
+void UserTable::StartJobs()
+{
+  uint64_t now = get_usec(CLOCK_MONOTONIC) / 1000;
+  
+  JOB_QUEUE::iterator it = s_jobQueue.begin();
+  while (it != s_jobQueue.end() && (s_uMaxJobs == 0 || s_procMap.size() < s_uMaxJobs)) {
+    UserTable* pUt = (*it).pTab;
+    if ((*it).notBefore <= now && pUt->MayStart((*it).pState)) {
+      if ((*it).pState->rate.pDelayed == &(*it).argv)
+        (*it).pState->rate.pDelayed = NULL;
+      Job_t job = *it;
+      it = s_jobQueue.erase(it);
+      s_uQueued--;
+      pUt->m_uQueued--;
+      pUt->StartJob(job);
+    }
+    else {
+      it++;
+    }
+  }
+}
+
+void UserTable::FinishDone()
+{
+  pid_t pid;
+  int status;
+  struct rusage ru;
+  while ((pid = wait4((pid_t) -1, &status, WNOHANG, &ru)) > 0) {
+    FinishJob(pid, status, &ru);
+  }
+  
+  // jobs started by launchers (the start is always reported first)
+  ProcStarted_t ps;
+  while (Launcher::GetStarted(ps)) {
+    PROC_MAP::iterator it = s_procMap.find(ps.id);
+    if (it == s_procMap.end()) {
+      if (ps.pidfd != -1)
+        close(ps.pidfd);
+      continue;
+    }
+    
+    if (ps.pid == -1) {
+      syslog(LOG_ERR, "cannot exec process: %s", strerror(ps.error));
+      FinishJob(ps.id, -1, NULL);
+      continue;
+    }
+    
+    ProcData_t& rPd = (*it).second;
+    rPd.pid = ps.pid;
+    if (rPd.killTimer != 0 && rPd.pidfd == -1)
+      rPd.pidfd = ps.pidfd;
+    else if (ps.pidfd != -1)
+      close(ps.pidfd);
+  }
+  
+  ProcDone_t pd;
+  while (Launcher::GetDone(pd)) {
+    FinishJob(pd.pid, pd.status, pd.status != -1 ? &pd.usage : NULL);
+  }
+  
+  // built-in file actions (failures look like exit status 1)
+  FileActionDone_t ad;
+  while (FileAction::GetDone(ad)) {
+    if (ad.error != 0)
+      syslog(LOG_ERR, "built-in action (job %u) failed: %s", (unsigned) -ad.id, strerror(ad.error));
+    FinishJob(ad.id, ad.error != 0 ? 1 << 8 : 0, &ad.usage);
+  }
+  
+  StartJobs();
+}
 
-    syslog(LOG_ERR, "cannot fork process: %s", strerror(errno));
+void UserTable::FinishJob(pid_t pid, int status, const struct rusage* pUsage)
+{
+  if (Coprocess::Finished(pid))
+    return;
+  
+  PROC_MAP::iterator it = s_procMap.find(pid);
+  if (it == s_procMap.end())
+    return;
+  
+  ProcData_t& rPd = (*it).second;
+  if (rPd.killTimer != 0)
+    rPd.pEd->GetTimers()->Cancel(rPd.killTimer);
+  if (rPd.pidfd != -1)
+    close(rPd.pidfd);
+  if (!rPd.manifest.empty())
+    unlink(rPd.manifest.c_str());
+  
+  uint64_t wall = get_usec(CLOCK_MONOTONIC) / 1000 - rPd.started;
+  add_usage(rPd.pState->usage, status, wall, pUsage);
+  if (rPd.pTab != NULL)
+    add_usage(rPd.pTab->m_stats.usage, status, wall, pUsage);
+  
+  if (rPd.pLog != NULL) {
+    char s[192];
+    int len;
+    if (status == -1)
+      len = snprintf(s, sizeof(s), "finished (status unknown)");
+    else if (WIFSIGNALED(status))
+      len = snprintf(s, sizeof(s), "finished (signal %i)", WTERMSIG(status));
+    else
+      len = snprintf(s, sizeof(s), "finished (exit %i)", WEXITSTATUS(status));
+    if (pUsage != NULL) {
+      snprintf(s + len, sizeof(s) - len, ", wall %llu ms, user %llu ms, sys %llu ms, max rss %li KB, blocks in %li, out %li",
+          (unsigned long long) wall,
+          (unsigned long long) tv_usec(pUsage->ru_utime) / 1000,
+          (unsigned long long) tv_usec(pUsage->ru_stime) / 1000,
+          pUsage->ru_maxrss, pUsage->ru_inblock, pUsage->ru_oublock);
+    }
+    rPd.pLog->Write(rPd.jobId, pid, s, strlen(s));
+    rPd.pLog->Release();
   }
+  if (rPd.pWatch != NULL) {
+    if (rPd.fNoLoop && rPd.pTab != NULL)
+      rPd.pTab->LeaveFlight(rPd.pWatch);
+    
+    std::pair<WATCHPROC_MAP::iterator, WATCHPROC_MAP::iterator> range = s_watchProcs.equal_range(rPd.pWatch);
+    for (WATCHPROC_MAP::iterator it2 = range.first; it2 != range.second; it2++) {
+      if ((*it2).second == pid) {
+        s_watchProcs.erase(it2);
+        break;
+      }
+    }
+  }
+  if (rPd.pTab != NULL)
+    rPd.pTab->m_uRunning--;
+  rPd.pState->limits.running--;
+  if (rPd.fKeyed)
+    ReleaseKey(rPd.pState, rPd.key, rPd.pTab);
+  release_state(rPd.pState);
+  s_procMap.erase(it);
+}
 
+void UserTable::OnReloadTimer(void* pArg)
+{
+  UserTable* pUt = (UserTable*) pArg;
+  pUt->m_reloadTimer = 0;
+  pUt->Reload();
 }
 
-IncronTabEntry* UserTable::FindEntry(InotifyWatch* pWatch)
+WatchEntry_t* UserTable::FindEntry(InotifyWatch* pWatch)
 {
   IWCE_MAP::iterator it = m_map.find(pWatch);
   if (it == m_map.end())
     return NULL;
 
-  return (*it).second;
+  return &(*it).second;
+}
+
+void UserTable::LeaveFlight(InotifyWatch* pWatch)
+{
+  WatchEntry_t* pWE = FindEntry(pWatch);
+  if (pWE == NULL || pWE->inFlight == 0)
+    return;
+  
+  if (--pWE->inFlight == 0 && pWE->pState->limits.cooldown > 0)
+    pWE->quietUntil = get_usec(CLOCK_MONOTONIC) / 1000 + pWE->pState->limits.cooldown;
+}
+
+bool UserTable::MayAccessCached(WatchEntry_t* pWE, const std::string& rPath, bool fNoFollow)
+{
+  AccessCache_t& rAc = pWE->access[fNoFollow ? 1 : 0];
+  uint64_t now = get_usec(CLOCK_MONOTONIC);
+  
+  // user data is fetched first because it may be reloaded
+  const UserCred_t* pCred = CredCache::Get(m_user);
+  bool fSameGen = rAc.gen == pCred->gen;
+  if (rAc.fKnown && fSameGen && now - rAc.checked < ACCESS_RECHECK)
+    return rAc.fAllow;
+  
+  struct stat st;
+  int res = fNoFollow
+      ? lstat(rPath.c_str(), &st) // don't follow symlink
+      : stat(rPath.c_str(), &st);
+  if (res != 0) {
+    rAc.fKnown = false;
+    return false; // retrieving permissions failed
+  }
+  
+  // the same file without status changes
+  if (rAc.fKnown && fSameGen
+      && rAc.dev == st.st_dev && rAc.ino == st.st_ino
+      && rAc.ctime.tv_sec == st.st_ctim.tv_sec && rAc.ctime.tv_nsec == st.st_ctim.tv_nsec)
+  {
+    rAc.checked = now;
+    return rAc.fAllow;
+  }
+  
+  rAc.fKnown = true;
+  rAc.fAllow = CheckAccess(pCred, st);
+  rAc.dev = st.st_dev;
+  rAc.ino = st.st_ino;
+  rAc.ctime = st.st_ctim;
+  rAc.gen = pCred->gen;
+  rAc.checked = now;
+  
+  return rAc.fAllow;
 }
 
 bool UserTable::MayAccess(const std::string& rPath, bool fNoFollow) const
@@ -530,89 +2010,214 @@ bool UserTable::MayAccess(const std::string& rPath, bool fNoFollow) const
       : stat(rPath.c_str(), &st);
   if (res != 0)
     return false; // retrieving permissions failed
+  
+  return CheckAccess(CredCache::Get(m_user), st);
+}
 
+bool UserTable::CheckAccess(const UserCred_t* pCred, const struct stat& st)
+{
   // file accessible to everyone
   if (st.st_mode & S_IRWXO)
     return true;
 
-  // retrieve user data
-  struct passwd* pwd = getpwnam(m_user.c_str());
+  if (!pCred->fValid)
+    return false;
 
   // root may always access
-  if (pwd->pw_uid == 0)
+  if (pCred->uid == 0)
     return true;
 
-  // file accessible to group
+  // file accessible to group (primary or supplementary)
   if (st.st_mode & S_IRWXG) {
-
-    // user's primary group
-    if (pwd != NULL && pwd->pw_gid == st.st_gid)
-        return true;
-
-    // now check group database
-    struct group *gr = getgrgid(st.st_gid);
-    if (gr != NULL) {
-      int pos = 0;
-      const char* un;
-      while ((un = gr->gr_mem[pos]) != NULL) {
-        if (strcmp(un, m_user.c_str()) == 0)
-          return true;
-        pos++;
-      }
-    }
+    if (CredCache::IsMember(pCred, st.st_gid))
+      return true;
   }
 
   // file accessible to owner
   if (st.st_mode & S_IRWXU) {
-    if (pwd != NULL && pwd->pw_uid == st.st_uid)
+    if (pCred->uid == st.st_uid)
       return true;
   }
 
   return false; // no access right found
 }
 
-#ifndef __linux__
-static int
-clearenv(void)
+bool UserTable::ParseDirect(const std::string& rCmd, std::vector<CMD_WORD>& rWords)
 {
-  extern char **environ;
+  rWords.clear();
+  
+  CMD_WORD word;
+  CmdSegment_t seg;
+  seg.wildcard = 0;
+  
+  size_t len = rCmd.length();
+  for (size_t i=0; i<=len; i++) {
+    char c = i < len ? rCmd[i] : ' ';
+    if (c == ' ' || c == '\t') {
+      if (!seg.text.empty()) {
+        word.push_back(seg);
+        seg.text.clear();
+      }
+      if (!word.empty()) {
+        rWords.push_back(word);
+        word.clear();
+      }
+    }
+    else if (strchr(SHELL_META, c) != NULL) {
+      return false;
+    }
+    else if (c == '#' && word.empty() && seg.text.empty()) {
+      return false; // comment
+    }
+    else if (c == '$') {
+      char cx = i + 1 < len ? rCmd[i+1] : 0;
+      if (cx == '$') {
+        return false;
+      }
+      else if (cx == '@' || cx == '#' || cx == '%' || cx == '&') {
+        if (!seg.text.empty()) {
+          word.push_back(seg);
+          seg.text.clear();
+        }
+        CmdSegment_t wc;
+        wc.wildcard = cx;
+        word.push_back(wc);
+        i++;
+      }
+      // other dollar signs are dropped (as when expanding for the shell)
+    }
+    else {
+      seg.text.push_back(c);
+    }
+  }
+  
+  // the program must be given by an absolute path (or be a built-in action)
+  return !rWords.empty()
+      && rWords[0][0].wildcard == 0
+      && (rWords[0][0].text[0] == '/' || (rWords[0][0].text[0] == '@' && rWords[0].size() == 1));
+}
 
-  environ[0] = NULL;
-  return 0;
+void UserTable::CompileShell(const std::string& rCmd, CMD_WORD& rTemplate)
+{
+  rTemplate.clear();
+  
+  CmdSegment_t seg;
+  seg.wildcard = 0;
+  
+  size_t len = rCmd.length();
+  size_t oldpos = 0;
+  size_t pos;
+  while ((pos = rCmd.find('$', oldpos)) != std::string::npos) {
+    seg.text.append(rCmd, oldpos, pos - oldpos);
+    char cx = pos + 1 < len ? rCmd[pos+1] : 0;
+    if (cx == '$') {
+      seg.text.push_back('$');
+      oldpos = pos + 2;
+    }
+    else if (cx == '@' || cx == '#' || cx == '%' || cx == '&') {
+      if (!seg.text.empty()) {
+        rTemplate.push_back(seg);
+        seg.text.clear();
+      }
+      CmdSegment_t wc;
+      wc.wildcard = cx;
+      rTemplate.push_back(wc);
+      oldpos = pos + 2;
+    }
+    else {
+      // unknown wildcards lose their dollar sign
+      oldpos = pos + 1;
+    }
+  }
+  
+  seg.text.append(rCmd, oldpos, std::string::npos);
+  if (!seg.text.empty())
+    rTemplate.push_back(seg);
 }
-#endif
 
-void UserTable::RunAsUser(std::string cmd) const
+void UserTable::ExpandWord(const CMD_WORD& rWord, bool fEscape, InotifyEvent& rEvt, const std::string& rPath, std::string& rOut)
 {
-  struct passwd* pwd = getpwnam(m_user.c_str());
-  if (    pwd == NULL                 // check query result
-      ||  setgid(pwd->pw_gid) != 0    // check GID
-      ||  initgroups(m_user.c_str(),pwd->pw_gid) != 0 // check supplementary groups
-      ||  setuid(pwd->pw_uid) != 0)    // check UID
-  {
-    goto failed;
+  for (size_t i=0; i<rWord.size(); i++) {
+    const CmdSegment_t& rSeg = rWord[i];
+    switch (rSeg.wildcard) {
+      case '@':   // base path
+        if (fEscape)
+          IncronTabEntry::AppendSafePath(rPath, rOut);
+        else
+          rOut.append(rPath);
+        break;
+      case '#':   // file name
+        if (fEscape)
+          IncronTabEntry::AppendSafePath(rEvt.GetName(), rOut);
+        else
+          rOut.append(rEvt.GetName());
+        break;
+      case '%':   // mask symbols
+        rEvt.DumpTypes(s_typesBuf);
+        rOut.append(s_typesBuf);
+        break;
+      case '&':   // numeric mask
+        {
+          char s[16];
+          char* p = s + sizeof(s);
+          uint32_t u = rEvt.GetMask();
+          do {
+            *--p = (char) ('0' + u % 10);
+            u /= 10;
+          } while (u > 0);
+          rOut.append(p, s + sizeof(s) - p);
+        }
+        break;
+      default:
+        rOut.append(rSeg.text);
+    }
   }
+}
 
-  if (pwd->pw_uid != 0) {
-    if (clearenv() != 0)
-      goto failed;
+std::string UserTable::GetEntryCgroup(int idx) const
+{
+  char s[32];
+  snprintf(s, sizeof(s), "/entry%i", idx);
+  return m_cgName + s;
+}
 
-    if (    setenv("LOGNAME",   pwd->pw_name,   1) != 0
-        ||  setenv("USER",      pwd->pw_name,   1) != 0
-        ||  setenv("USERNAME",  pwd->pw_name,   1) != 0
-        ||  setenv("HOME",      pwd->pw_dir,    1) != 0
-        ||  setenv("SHELL",     pwd->pw_shell,  1) != 0
-        ||  setenv("PATH",      DEFAULT_PATH,   1) != 0)
-    {
-      goto failed;
+pid_t UserTable::RunAsUser(const ARGV& rArgv, const int* fds, int iCgroupFd, const JobSched_t* pSched) const
+{
+  static const int s_inherit[3] = { -1, -1, -1 };
+  if (fds == NULL)
+    fds = s_inherit;
+  
+  std::vector<char*> argv;
+  for (size_t i=0; i<rArgv.size(); i++) {
+    argv.push_back((char*) rArgv[i].c_str());
+  }
+  argv.push_back(NULL);
+  
+  SpawnParams_t sp;
+  JobSpawner::Init(sp);
+  sp.path = argv[0];
+  sp.argv = &argv[0];
+  memcpy(sp.fds, fds, sizeof(sp.fds));
+  sp.cgroupFd = iCgroupFd;
+  sp.pSched = pSched;
+  
+  if (!m_fSysTable) {
+    const UserCred_t* pCred = CredCache::Get(m_user);
+    if (!pCred->fValid) {
+      errno = ENOENT;
+      return -1;
     }
+    
+    sp.fSetCreds = true;
+    sp.uid = pCred->uid;
+    sp.gid = pCred->gid;
+    sp.groups = pCred->groups.empty() ? NULL : &pCred->groups[0];
+    sp.ngroups = pCred->groups.size();
+    
+    if (!pCred->envp.empty())
+      sp.envp = &pCred->envp[0];
   }
   
-  execlp("/bin/bash","/bin/bash", "-c", cmd.c_str(), (char *)NULL);
-
-failed:
-
-  syslog(LOG_ERR, "cannot exec process: %s", strerror(errno));
-  _exit(1);
+  return JobSpawner::Spawn(sp);
 }
 
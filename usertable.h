@@ -19,36 +19,290 @@
 
 #include <map>
 #include <deque>
+#include <list>
+#include <vector>
+#include <time.h>
 #include <sys/poll.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 #include "inotify-cxx.h"
 #include "incrontab.h"
+#include "timerwheel.h"
+#include "credcache.h"
+#include "jobspawn.h"
+#include "fileaction.h"
 
 
 class UserTable;
+class Coprocess;
+class JobLog;
+class EventDispatcher;
+class Plugin;
+
+// this is not enough, but...
+#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin:/usr/X11R6/bin"
 
 /// User name to user table mapping definition
 typedef std::map<std::string, UserTable*> SUT_MAP;
 
-/// Callback for calling after a process finishes.
-typedef void (*proc_done_cb)(InotifyWatch*);
+/// Command word segment
+typedef struct
+{
+  char wildcard;    ///< wildcard character ('@', '#', '%', '&'); 0 = literal text
+  std::string text; ///< literal text
+} CmdSegment_t;
+
+/// Command word (sequence of segments)
+typedef std::vector<CmdSegment_t> CMD_WORD;
+
+/// Argument vector
+typedef std::vector<std::string> ARGV;
+
+/// Job key modes
+typedef enum
+{
+  KM_NONE,      ///< no key
+  KM_COLLAPSE,  ///< jobs collapsed (at most one active and one waiting)
+  KM_ORDER      ///< jobs run one after another in the event order
+} KeyMode_t;
+
+/// Entry runtime state (see below)
+typedef struct EntryState EntryState_t;
+
+/// Queued job data
+typedef struct
+{
+  UserTable* pTab;      ///< owning table
+  EntryState_t* pState; ///< entry runtime state
+  InotifyWatch* pWatch; ///< related watch (NULL = watch gone)
+  bool fNoLoop;         ///< loop avoidance yes/no
+  ARGV argv;            ///< argument vector
+  std::string input;    ///< standard input data (empty = inherited)
+  bool fManifest;       ///< pass the input as a manifest file yes/no
+  bool fKeyed;          ///< job holds a key slot yes/no
+  std::string key;      ///< job key
+  uint64_t notBefore;   ///< earliest start time (monotonic milliseconds; 0 = now)
+} Job_t;
+
+/// Key slot (jobs sharing a key)
+typedef struct
+{
+  bool fStarted;      ///< the active job has been started yes/no
+  std::deque<Job_t> waiting;  ///< jobs waiting for the active one
+} KeySlot_t;
+
+/// Key-to-slot mapping
+typedef std::map<std::string, KeySlot_t> KEYSLOT_MAP;
+
+/// Token bucket (rate limit)
+typedef struct
+{
+  double rate;        ///< tokens added per second (0 = unlimited)
+  double burst;       ///< bucket capacity
+  double tokens;      ///< available tokens (negative = reserved by delayed jobs)
+  uint64_t last;      ///< last refill time (monotonic milliseconds)
+} TokenBucket_t;
+
+/// Job resource usage (running totals of finished jobs)
+typedef struct
+{
+  uint64_t jobs;      ///< count of finished jobs
+  uint64_t failed;    ///< count of jobs with a non-zero (or unknown) status
+  uint64_t wall;      ///< wall clock time (milliseconds)
+  uint64_t user;      ///< user CPU time (microseconds)
+  uint64_t sys;       ///< system CPU time (microseconds)
+  uint64_t maxRss;    ///< maximum resident set size of a job (kilobytes)
+  uint64_t inBlock;   ///< count of block input operations
+  uint64_t outBlock;  ///< count of block output operations
+} JobUsage_t;
+
+/// Command of an entry
+typedef struct
+{
+  bool fDirect;       ///< command executed directly (without shell) yes/no
+  std::vector<CMD_WORD> words;  ///< command words (for direct execution)
+  CMD_WORD shellCmd;  ///< command template (for shell execution)
+  FileOp_t fileOp;    ///< built-in file action (FO_NONE = command)
+  bool fDisabled;     ///< entry disabled (not watched) because of an invalid command yes/no
+} CmdState_t;
+
+/// Job limits of an entry
+typedef struct
+{
+  bool fPriority;     ///< high priority yes/no
+  unsigned maxJobs;   ///< maximum count of running jobs (0 = unlimited)
+  unsigned running;   ///< count of running jobs
+  int cgFd;           ///< cgroup.procs descriptor of the entry's cgroup (-1 = table's one)
+  unsigned timeout;   ///< job time limit (s; 0 = unlimited)
+  unsigned killAfter; ///< time between SIGTERM and SIGKILL (s)
+  unsigned cooldown;  ///< loop avoidance cooldown (ms)
+  bool fSched;        ///< scheduling attributes set yes/no
+  JobSched_t sched;   ///< job scheduling attributes
+} LimitState_t;
+
+/// Batching state of an entry
+typedef struct
+{
+  unsigned size;      ///< maximum count of events in a batch (0 = unlimited)
+  unsigned time;      ///< maximum batch accumulation time (ms; 0 = no batching)
+  BatchMode_t mode;   ///< batch mode
+  ARGV argv;          ///< command of the pending batch
+  std::vector<std::string> names; ///< file names of the pending batch
+  TimerId_t timer;    ///< batch flushing timer
+} BatchState_t;
+
+/// Coprocess state of an entry
+typedef struct
+{
+  CoprocMode_t mode;  ///< coprocess mode
+  bool fAck;          ///< coprocess acknowledgements yes/no
+  Coprocess* pCoproc; ///< coprocess (NULL = not created yet)
+} CoprocState_t;
+
+/// Job key state of an entry
+typedef struct
+{
+  KeyMode_t mode;     ///< job key mode
+  CMD_WORD templ;     ///< job key template
+  KEYSLOT_MAP slots;  ///< key slots (existing only while a job is active)
+} KeyState_t;
 
-/// Child process data
+/// Rate limiting state of an entry
 typedef struct
 {
-  proc_done_cb onDone;  ///< function called after process finishes
-  InotifyWatch* pWatch; ///< related watch
+  TokenBucket_t bucket; ///< rate limit
+  RatePolicy_t policy;  ///< rate limiting policy
+  ARGV* pDelayed;     ///< arguments of the delayed job (for coalescing; NULL = none)
+} RateState_t;
+
+/// Plugin state of an entry
+typedef struct
+{
+  bool fInProcess;    ///< in-process plugin entry yes/no
+  Plugin* pPlugin;    ///< in-process plugin (NULL = not loaded)
+} PluginState_t;
+
+/// Entry runtime state (shared by an entry and its subdirectory entries)
+struct EntryState
+{
+  UserTable* pTab;    ///< owning table
+  unsigned refs;      ///< reference count (table, queued and running jobs)
+  std::string ident;  ///< entry identity (path, mask and command)
+  CmdState_t cmd;     ///< command
+  LimitState_t limits;  ///< job limits
+  BatchState_t batch; ///< batching
+  CoprocState_t coproc; ///< coprocess
+  KeyState_t key;     ///< job keys
+  RateState_t rate;   ///< rate limiting
+  PluginState_t plugin; ///< plugin
+  JobUsage_t usage;   ///< resource usage of the entry's jobs
+};
+
+/// Child process data (built-in file actions and launcher jobs have negative pseudo process IDs)
+typedef struct
+{
+  pid_t pid;            ///< process ID (0 = none or not known yet)
+  bool fNoLoop;         ///< loop avoidance yes/no (the job is in flight for its watch)
+  InotifyWatch* pWatch; ///< related watch (NULL = watch gone)
+  UserTable* pTab;      ///< owning table (NULL = table gone)
+  EntryState_t* pState; ///< entry runtime state
+  std::string manifest; ///< batch manifest file (removed when finished)
+  unsigned jobId;       ///< job ID
+  JobLog* pLog;         ///< job log (NULL = not logged)
+  EventDispatcher* pEd; ///< event dispatcher (for the kill timer)
+  TimerId_t killTimer;  ///< time limit timer (0 = none)
+  unsigned killStage;   ///< signals sent (0 = none, 1 = SIGTERM, 2 = SIGKILL)
+  int pidfd;            ///< process descriptor (-1 = none)
+  bool fKeyed;          ///< job holds a key slot yes/no
+  std::string key;      ///< job key
+  uint64_t started;     ///< start time (monotonic milliseconds)
 } ProcData_t;
 
+/// Cached access decision
+typedef struct
+{
+  bool fKnown;        ///< decision made yes/no
+  bool fAllow;        ///< access allowed yes/no
+  dev_t dev;          ///< device of the watched file
+  ino_t ino;          ///< inode of the watched file
+  struct timespec ctime;  ///< status change time of the watched file
+  unsigned gen;       ///< generation of the user's credentials
+  uint64_t checked;   ///< last check time (microseconds)
+} AccessCache_t;
+
+/// Watch-related entry data
+typedef struct
+{
+  IncronTabEntry* pEntry; ///< table entry
+  EntryState_t* pState;   ///< entry runtime state
+  AccessCache_t access[2];  ///< access decisions (following symlinks, not following)
+  unsigned inFlight;      ///< count of jobs with loop avoidance (queued or running)
+  uint64_t quietUntil;    ///< end of the loop avoidance cooldown (ms, monotonic)
+} WatchEntry_t;
+
+/// Table statistics (running totals)
+typedef struct
+{
+  uint64_t events;    ///< count of processed events
+  uint64_t busy;      ///< time spent processing events (microseconds)
+  uint64_t cpu;       ///< CPU time spent processing events (microseconds)
+  uint64_t delay;     ///< total queueing delay of events (microseconds)
+  uint64_t maxDelay;  ///< maximum queueing delay (microseconds)
+  uint64_t timeouts;  ///< count of jobs terminated for exceeding their time limit
+  uint64_t kills;     ///< count of such jobs which had to be killed
+  uint64_t suppressed;  ///< count of events suppressed by loop avoidance
+  uint64_t collapsed;   ///< count of jobs merged into other ones
+  uint64_t throttled;   ///< count of jobs over rate limits (delayed, dropped or merged)
+  JobUsage_t usage;     ///< resource usage of finished jobs
+} TableStats_t;
+
+/// Initializes a token bucket.
+/**
+ * The bucket starts full.
+ * 
+ * \param[out] rB token bucket
+ * \param[in] rate tokens per second (0 = unlimited)
+ * \param[in] burst capacity (0 = one second worth of tokens, at least one)
+ */
+void init_bucket(TokenBucket_t& rB, double rate, unsigned burst);
+
+/// Refills a token bucket.
+/**
+ * \param[in,out] rB token bucket
+ * \param[in] now current time (monotonic milliseconds)
+ */
+void refill_bucket(TokenBucket_t& rB, uint64_t now);
+
 /// fd-to-usertable mapping
 typedef std::map<int, UserTable*> FDUT_MAP;
 
 /// Watch-to-tableentry mapping
-typedef std::map<InotifyWatch*, IncronTabEntry*> IWCE_MAP;
+typedef std::map<InotifyWatch*, WatchEntry_t> IWCE_MAP;
 
 /// Child process list
 typedef std::map<pid_t, ProcData_t> PROC_MAP;
 
+/// Watch-to-process mapping (jobs related to watches)
+typedef std::multimap<InotifyWatch*, pid_t> WATCHPROC_MAP;
+
+/// Job run queue
+typedef std::list<Job_t> JOB_QUEUE;
+
+/// Callback for calling when a descriptor becomes ready.
+typedef void (*fd_cb)(int iFd, short revents, void* pArg);
+
+/// Descriptor callback data
+typedef struct
+{
+  fd_cb cb;       ///< function called when the descriptor is ready
+  void* pArg;     ///< callback argument
+  short events;   ///< polled events
+} FdData_t;
+
+/// fd-to-callback mapping
+typedef std::map<int, FdData_t> FDCB_MAP;
+
 /// Event dispatcher class.
 /**
  * This class processes events and distributes them as needed.
@@ -86,9 +340,30 @@ public:
    */
   void Unregister(UserTable* pTab);
   
+  /// Registers a descriptor for polling.
+  /**
+   * The callback is called from ProcessEvents() when the
+   * descriptor becomes ready. Registering an already registered
+   * descriptor replaces its callback.
+   * 
+   * \param[in] iFd descriptor
+   * \param[in] events polled events
+   * \param[in] cb function called when the descriptor is ready
+   * \param[in] pArg callback argument
+   */
+  void RegisterFd(int iFd, short events, fd_cb cb, void* pArg);
+  
+  /// Unregisters a polled descriptor.
+  /**
+   * \param[in] iFd descriptor
+   */
+  void UnregisterFd(int iFd);
+  
   /// Returns the poll data size.
   /**
    * \return poll data size
+   * 
+   * \attention Call GetPollData() first.
    */
   inline size_t GetSize() const
   {
@@ -97,16 +372,29 @@ public:
   
   /// Returns the poll data.
   /**
+   * The array is rebuilt here if registrations have changed.
+   * 
    * \return poll data
    */
   inline struct pollfd* GetPollData()
   {
+    if (m_fRebuild)
+      Rebuild();
     return m_pPoll;
   }
   
   /// Rebuilds the poll array data.
   void Rebuild();
   
+  /// Returns the timer wheel.
+  /**
+   * \return timer wheel
+   */
+  inline TimerWheel* GetTimers()
+  {
+    return &m_timers;
+  }
+  
   /// Removes all registered user tables.
   /**
    * It doesn't cause poll data rebuilding.
@@ -123,8 +411,11 @@ private:
   InotifyWatch* m_pSys;   ///< watch for system tables
   InotifyWatch* m_pUser;  ///< watch for user tables 
   FDUT_MAP m_maps;  ///< watch-to-usertable mapping
+  FDCB_MAP m_fds;   ///< other polled descriptors
+  TimerWheel m_timers;    ///< timer wheel
   size_t m_size;    ///< poll data size
   struct pollfd* m_pPoll; ///< poll data array
+  bool m_fRebuild;  ///< poll data rebuilding needed yes/no
   
   /// Processes events on the table management inotify object. 
   void ProcessMgmtEvents();
@@ -159,7 +450,12 @@ public:
    */
   void Load();
   
-  void AddTabEntry(IncronTabEntry& rE);
+  /// Creates a watch for an entry.
+  /**
+   * \param[in] rE table entry
+   * \param[in] pState entry runtime state
+   */
+  void AddTabEntry(IncronTabEntry& rE, EntryState_t* pState);
 
   /// Removes all entries from the table.
   /**
@@ -168,11 +464,64 @@ public:
    */
   void Dispose();
   
+  /// Reloads the table.
+  /**
+   * Entries with unchanged paths, masks and commands keep
+   * their runtime state - running job counts, job key slots,
+   * token buckets, resource usage, plugins and coprocesses
+   * (unless the coprocess options change).
+   */
+  void Reload();
+  
   /// Processes an inotify event.
   /**
+   * The time spent here is accounted in the table statistics.
+   * 
    * \param[in] rEvt inotify event
    */
   void OnEvent(InotifyEvent& rEvt);
+  
+  /// Returns the table statistics.
+  /**
+   * \return statistics
+   */
+  inline const TableStats_t& GetStats() const
+  {
+    return m_stats;
+  }
+  
+  /// Writes the table statistics to the system log.
+  /**
+   * Job resource usage is written for the table and
+   * for each entry (since the entry was loaded).
+   */
+  void DumpStats() const;
+  
+  /// Processes finished child processes.
+  /**
+   * It reaps all finished children and starts queued jobs
+   * for which free slots have appeared. Jobs reported as started
+   * by launchers get their process IDs.
+   */
+  static void FinishDone();
+  
+  /// Returns the count of running jobs (of all tables).
+  /**
+   * \return count of running jobs
+   */
+  inline static size_t GetRunningCount()
+  {
+    return s_procMap.size();
+  }
+  
+  /// Returns the count of queued jobs (of all tables).
+  /**
+   * \return count of queued jobs
+   */
+  inline static size_t GetQueuedCount()
+  {
+    return s_uQueued;
+  }
 
   /// Checks whether the user may access a file.
   /**
@@ -184,6 +533,20 @@ public:
    */
   bool MayAccess(const std::string& rPath, bool fNoFollow) const;
   
+  /// Checks whether the user may access a watched file.
+  /**
+   * The decision is cached for the watch (thus for the watched
+   * inode). It is revalidated if the file's inode or status change
+   * time differs (checked at most once in ACCESS_RECHECK), if user
+   * data changes or after an IN_ATTRIB event on the file itself.
+   * 
+   * \param[in] pWE watch entry
+   * \param[in] rPath watched path
+   * \param[in] fNoFollow don't follow a symbolic link
+   * \return true = access granted, false = otherwise
+   */
+  bool MayAccessCached(WatchEntry_t* pWE, const std::string& rPath, bool fNoFollow);
+  
   /// Checks whether it is a system table.
   /**
    * \return true = system table, false = user table
@@ -221,9 +584,77 @@ public:
   
   /// Runs a program as the table's user.
   /**
-   * \attention Don't call from the main process (before forking)!
+   * Programs of system tables run with the daemon's environment.
+   * Programs of user tables run with the user's credentials and
+   * (for non-root users) a minimal environment.
+   * 
+   * \param[in] rArgv argument vector (the first one is the program path)
+   * \param[in] fds standard input, output and error (-1 = inherited; NULL = all inherited)
+   * \param[in] iCgroupFd cgroup.procs descriptor of the target cgroup (-1 = none)
+   * \param[in] pSched scheduling attributes (NULL = inherited)
+   * \return process ID; -1 on error (errno is set)
    */
-  void RunAsUser(std::string cmd) const;
+  pid_t RunAsUser(const ARGV& rArgv, const int* fds = NULL, int iCgroupFd = -1, const JobSched_t* pSched = NULL) const;
+  
+  /// Returns the cgroup for jobs of an entry.
+  /**
+   * \param[in] pState entry runtime state
+   * \return cgroup.procs descriptor (-1 = no cgroup)
+   */
+  inline int GetCgroupFd(const EntryState_t* pState) const
+  {
+    return pState->limits.cgFd != -1 ? pState->limits.cgFd : m_cgFd;
+  }
+  
+  /// Returns the cgroup name of an entry.
+  /**
+   * \param[in] idx entry index
+   * \return cgroup name (relative to the cgroup root)
+   */
+  std::string GetEntryCgroup(int idx) const;
+  
+  /// Splits a command into words for direct execution.
+  /**
+   * Only commands starting with an absolute path (or a built-in
+   * action name like "@move") and containing no shell
+   * metacharacters (quotes, escapes, redirections, pipes,
+   * globs etc.) can be executed directly. The '$$' wildcard also
+   * requires the shell.
+   * 
+   * \param[in] rCmd command string
+   * \param[out] rWords command words
+   * \return true = direct execution possible, false = shell needed
+   */
+  static bool ParseDirect(const std::string& rCmd, std::vector<CMD_WORD>& rWords);
+  
+  /// Decides about access to a file.
+  /**
+   * \param[in] pCred user credentials
+   * \param[in] st file status
+   * \return true = access granted, false = otherwise
+   */
+  static bool CheckAccess(const UserCred_t* pCred, const struct stat& st);
+  
+  /// Compiles a command for shell execution.
+  /**
+   * The whole command becomes one template. '$$' becomes
+   * a literal dollar sign and unknown wildcards lose their
+   * dollar sign.
+   * 
+   * \param[in] rCmd command string
+   * \param[out] rTemplate command template
+   */
+  static void CompileShell(const std::string& rCmd, CMD_WORD& rTemplate);
+  
+  /// Expands a command word (or template) for an event.
+  /**
+   * \param[in] rWord command word
+   * \param[in] fEscape escape paths and names for the shell yes/no
+   * \param[in] rEvt inotify event
+   * \param[in] rPath watched path
+   * \param[out] rOut output (the expansion is appended)
+   */
+  static void ExpandWord(const CMD_WORD& rWord, bool fEscape, InotifyEvent& rEvt, const std::string& rPath, std::string& rOut);
   
 private:
   Inotify m_in;           ///< inotify object
@@ -232,15 +663,213 @@ private:
   bool m_fSysTable;       ///< system table yes/no
   IncronTab m_tab;        ///< incron table
   IWCE_MAP m_map;         ///< watch-to-entry mapping
+  TimerId_t m_reloadTimer;  ///< delayed reload timer
+  TableStats_t m_stats;   ///< statistics
+  unsigned m_uMaxJobs;    ///< maximum count of running jobs (0 = unlimited)
+  unsigned m_uRunning;    ///< count of running jobs
+  unsigned m_uQueued;     ///< count of queued jobs
+  std::vector<EntryState_t*> m_states;  ///< runtime states of loaded entries
+  bool m_fLauncher;       ///< start jobs through the user launcher yes/no
+  std::string m_cgName;   ///< cgroup name
+  int m_cgFd;             ///< cgroup.procs descriptor of the table's leaf cgroup (-1 = none)
+  JobLog* m_pLog;         ///< job output log (NULL = not logged)
+  TokenBucket_t m_bucket; ///< rate limit of the table
 
   static PROC_MAP s_procMap;  ///< child process mapping
+  static WATCHPROC_MAP s_watchProcs;  ///< processes by watches
+  static JOB_QUEUE s_jobQueue;  ///< job run queue
+  static size_t s_uQueued;    ///< count of queued jobs
+  static unsigned s_uMaxJobs; ///< maximum count of running jobs (0 = unlimited)
+  static unsigned s_uJobId;   ///< last job ID
+  static std::string s_cmdBuf;    ///< command expansion buffer
+  static std::string s_typesBuf;  ///< event type names buffer
+  
+  /// Reloads the table (called by the delayed reload timer).
+  /**
+   * \param[in] pArg user table
+   */
+  static void OnReloadTimer(void* pArg);
+  
+  /// Removes all watches.
+  /**
+   * The table is unregistered from the event dispatcher.
+   */
+  void RemoveWatches();
+  
+  /// Closes the cgroups of the table and its entries.
+  void CloseCgroups();
+  
+  /// Releases an entry runtime state of the table.
+  /**
+   * A pending batch is run, the coprocess and plugin are
+   * destroyed.
+   * 
+   * \param[in] pState entry runtime state
+   */
+  void RetireState(EntryState_t* pState);
+  
+  /// Processes an inotify event (without accounting).
+  /**
+   * \param[in] rEvt inotify event
+   */
+  void ProcessEvent(InotifyEvent& rEvt);
   
-  /// Finds an entry for a watch.
+  /// Finds entry data for a watch.
   /**
    * \param[in] pWatch inotify watch
-   * \return pointer to the appropriate entry; NULL if no such entry exists
+   * \return pointer to the appropriate entry data; NULL if no such entry exists
+   */
+  WatchEntry_t* FindEntry(InotifyWatch* pWatch);
+  
+  /// Ends loop avoidance for a finished (or failed) job.
+  /**
+   * \param[in] pWatch related watch
+   */
+  void LeaveFlight(InotifyWatch* pWatch);
+  
+  /// Writes job resource usage to the system log.
+  /**
+   * \param[in] pszWhat what the usage belongs to ("jobs" or an entry path)
+   * \param[in] rU resource usage
+   */
+  void DumpUsage(const char* pszWhat, const JobUsage_t& rU) const;
+  
+  /// Checks whether a job of an entry may start now.
+  /**
+   * \param[in] pState entry runtime state
+   * \return true = all limits allow the job, false = otherwise
+   */
+  bool MayStart(const EntryState_t* pState) const;
+  
+  /// Submits a job for starting.
+  /**
+   * The job is started at once if the limits allow it, otherwise
+   * it is queued. High priority jobs are queued behind other
+   * high priority ones but ahead of the rest. Rate limits are
+   * applied here.
+   * 
+   * \param[in] rJob job data
+   * \param[in] fPriority high priority yes/no
+   * \return true = job started or queued, false = job dropped or merged by rate limits
+   */
+  bool Submit(Job_t& rJob, bool fPriority);
+  
+  /// Applies rate limits to a job.
+  /**
+   * A job over the limits is delayed (by setting its start
+   * time), dropped or merged into the delayed one.
+   * 
+   * \param[in,out] rJob job data
+   * \return true = job to be submitted, false = job dropped or merged
+   */
+  bool Throttle(Job_t& rJob);
+  
+  /// Cleans up after a job which won't run.
+  /**
+   * \param[in] rJob job data
+   */
+  void DropJob(const Job_t& rJob);
+  
+  /// Starts delayed jobs (called by the rate timer).
+  /**
+   * \param[in] pArg unused
+   */
+  static void OnRateTimer(void* pArg);
+  
+  /// Starts a job.
+  /**
+   * \param[in] rJob job data
+   */
+  void StartJob(const Job_t& rJob);
+  
+  /// Starts the program of a job.
+  /**
+   * If enabled, programs of user tables are started by the user's
+   * launcher process. Their process IDs are reported later
+   * (see FinishDone()), until then the jobs are known by their
+   * pseudo process IDs.
+   * 
+   * \param[in] id pseudo process ID of the job
+   * \param[in] rArgv argument vector (the first one is the program path)
+   * \param[in] fds standard input, output and error (-1 = inherited)
+   * \param[in] iCgroupFd cgroup.procs descriptor of the target cgroup (-1 = none)
+   * \param[in] pSched scheduling attributes (NULL = inherited)
+   * \return process ID (the pseudo one if started by the launcher); 0 on error (errno is set)
+   */
+  pid_t Launch(pid_t id, const ARGV& rArgv, const int* fds, int iCgroupFd, const JobSched_t* pSched);
+  
+  /// Starts a built-in file action.
+  /**
+   * \param[in] rJob job data
+   */
+  void StartAction(const Job_t& rJob);
+  
+  /// Registers a started job.
+  /**
+   * \param[in] rJob job data
+   * \param[in] pid process ID (negative for built-in actions and launcher jobs)
+   * \param[in] jobId job ID
+   * \param[in] rManifest batch manifest file (empty = none)
+   */
+  void TrackJob(const Job_t& rJob, pid_t pid, unsigned jobId, const std::string& rManifest);
+  
+  /// Creates a job for the pending batch of an entry.
+  /**
+   * \param[in] pState entry runtime state
+   */
+  void FlushBatch(EntryState_t* pState);
+  
+  /// Holds a job behind an active one of the same key.
+  /**
+   * If there is no active job of the key the job becomes
+   * the active one. Otherwise it waits for the active one.
+   * When collapsing, a job is merged into the active one if that
+   * has not been started yet (which then runs with the newer
+   * arguments), and only the newest job waits.
+   * 
+   * \param[in,out] rJob job (with the key set)
+   * \return true = job held or merged (not to be submitted), false = job to be submitted
+   */
+  bool HoldByKey(Job_t& rJob);
+  
+  /// Releases the key slot of a finished (or failed) job.
+  /**
+   * The next waiting job is submitted now.
+   * 
+   * \param[in] pState entry runtime state
+   * \param[in] rKey job key
+   * \param[in] pTab owning table (NULL = table gone)
+   */
+  static void ReleaseKey(EntryState_t* pState, const std::string& rKey, UserTable* pTab);
+  
+  /// Flushes a pending batch (called by the batch timer).
+  /**
+   * \param[in] pArg entry runtime state
+   */
+  static void OnBatchTimer(void* pArg);
+  
+  /// Enforces the time limit of a job (called by the kill timer).
+  /**
+   * The job is terminated first, then killed and finally
+   * abandoned if it still doesn't finish.
+   * 
+   * \param[in] pArg process ID
+   */
+  static void OnKillTimer(void* pArg);
+  
+  /// Starts queued jobs as long as limits allow.
+  static void StartJobs();
+  
+  /// Processes a finished job.
+  /**
+   * The job's resource usage is accounted to its entry
+   * and table.
+   * 
+   * \param[in] pid process ID
+   * \param[in] status exit status (-1 = unknown)
+   * \param[in] pUsage resource usage (NULL = unknown)
    */
-  IncronTabEntry* FindEntry(InotifyWatch* pWatch);
+  static void FinishJob(pid_t pid, int status, const struct rusage* pUsage);
  
 };
 